@@ -0,0 +1,345 @@
+// Copyright (c) 2014 Robert Kooima
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+
+#ifndef GLCAPTURE_HPP
+#define GLCAPTURE_HPP
+
+/// This header provides non-blocking capture of rendered frames to numbered
+/// Targa files. Each frame is read into a ring of pixel pack buffers and
+/// mapped once its fence has signaled, which is polled rather than awaited,
+/// so the render thread does not wait on the GPU. Writer threads read frames
+/// directly from the mappings, then encode and write the files.
+
+//------------------------------------------------------------------------------
+
+#include "GLImage.hpp"
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <deque>
+#include <condition_variable>
+
+//------------------------------------------------------------------------------
+
+namespace gl
+{
+    class capture
+    {
+    public:
+
+        /// Create an idle capture with a ring of n pixel pack buffers, at
+        /// least two, and the given number of writer threads. If every buffer
+        /// is still in use when a frame is read, the ring grows by one, up to
+        /// q more buffers, before frame() waits. No frame is ever dropped.
+
+        capture(int n = 3, int threads = 2, int q = 16) :
+            writers(threads), limit(std::max(n, 2) + q), head(0), count(0),
+            running(false)
+        {
+            for (int i = 0; i < std::max(n, 2); i++)
+                ring.push_back(std::unique_ptr<slot>(new slot()));
+        }
+
+       ~capture()
+        {
+            stop();
+        }
+
+        /// Begin capturing to files named by printf pattern, which receives
+        /// the frame number, e.g. "frame%05d.tga".
+
+        void start(const char *pattern)
+        {
+            stop();
+
+            name    = pattern;
+            count   = 0;
+            running = true;
+
+            for (size_t i = 0; i < writers.size(); i++)
+                writers[i] = std::thread(&capture::write, this);
+        }
+
+        /// Finish all pending frames and stop capturing. This must be called
+        /// with the context current.
+
+        void stop()
+        {
+            if (running)
+            {
+                const int n = int(ring.size());
+
+                for (int i = 0; i < n; i++)
+                    retire(*ring[(head + i) % n], true);
+                for (int i = 0; i < n; i++)
+                    release(*ring[i], true);
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    running = false;
+                }
+                ready.notify_all();
+
+                for (size_t i = 0; i < writers.size(); i++)
+                    writers[i].join();
+
+                for (int i = 0; i < n; i++)
+                    if (ring[i]->pbo)
+                    {
+                        glDeleteBuffers(1, &ring[i]->pbo);
+                        ring[i]->pbo  = 0;
+                        ring[i]->size = 0;
+                    }
+            }
+        }
+
+        /// Return true if capturing.
+
+        bool active() const
+        {
+            return running;
+        }
+
+        /// Queue a read of the w by h back buffer. Call this before swapping.
+
+        void frame(int w, int h)
+        {
+            if (running)
+            {
+                int n = int(ring.size());
+
+                // Map every completed read, oldest first, and unmap every
+                // frame the writers are done with, without waiting for either.
+
+                for (int i = 0; i < n; i++)
+                    if (!retire(*ring[(head + i) % n], false))
+                        break;
+
+                for (int i = 0; i < n; i++)
+                    release(*ring[i], false);
+
+                // If the oldest slot is still busy, grow the ring rather than
+                // wait for it, unless the ring has reached its limit.
+
+                if (ring[head]->fence || ring[head]->map)
+                {
+                    if (n < limit)
+                    {
+                        ring.insert(ring.begin() + head,
+                                    std::unique_ptr<slot>(new slot()));
+                        n++;
+                    }
+                    else
+                    {
+                        retire (*ring[head], true);
+                        release(*ring[head], true);
+                    }
+                }
+
+                slot& s = *ring[head];
+
+                const GLsizeiptr z = GLsizeiptr(w) * h * 4;
+
+                GLint a = 4;
+                GLint b = GL_BACK;
+
+                if (s.pbo == 0)
+                    glGenBuffers(1, &s.pbo);
+
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+
+                if (s.size != z)
+                {
+                    glBufferData(GL_PIXEL_PACK_BUFFER, z, 0, GL_STREAM_READ);
+                    s.size = z;
+                }
+
+                glGetIntegerv(GL_PACK_ALIGNMENT, &a);
+                glGetIntegerv(GL_READ_BUFFER,    &b);
+                glPixelStorei(GL_PACK_ALIGNMENT, 4);
+                glReadBuffer(GL_BACK);
+                glReadPixels(0, 0, w, h, GL_BGRA, GL_UNSIGNED_BYTE, 0);
+                glReadBuffer(GLenum(b));
+                glPixelStorei(GL_PACK_ALIGNMENT, a);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+                s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                s.w     = w;
+                s.h     = h;
+                s.index = count++;
+
+                head = (head + 1) % n;
+            }
+        }
+
+    private:
+
+        struct slot
+        {
+            GLuint      pbo;
+            GLsync      fence;
+            GLsizeiptr  size;
+            const void *map;
+            bool        busy;
+            int         w;
+            int         h;
+            int         index;
+        };
+
+        /// A frame to be written, read from the mapping of slot s.
+
+        struct job
+        {
+            const void *p;
+            slot       *s;
+            int         w;
+            int         h;
+            int         index;
+        };
+
+        /// Map the read pending in slot s, if any, and hand it to the writers.
+        /// If wait is false and the read has not completed, return false.
+
+        bool retire(slot& s, bool wait)
+        {
+            if (s.fence)
+            {
+                GLenum r;
+
+                do
+                    r = glClientWaitSync(s.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                         wait ? GLuint64(1000000000) : 0);
+                while (wait && r == GL_TIMEOUT_EXPIRED);
+
+                if (r == GL_TIMEOUT_EXPIRED)
+                    return false;
+
+                glDeleteSync(s.fence);
+                s.fence = 0;
+
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+
+                const void *m = 0;
+
+                if (r != GL_WAIT_FAILED)
+                    m = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, s.size,
+                                         GL_MAP_READ_BIT);
+                if (m)
+                {
+                    job j = { m, &s, s.w, s.h, s.index };
+
+                    std::lock_guard<std::mutex> lock(mutex);
+                    s.map  = m;
+                    s.busy = true;
+                    queue.push_back(j);
+                    ready.notify_one();
+                }
+                else fprintf(stderr, "Failed to read frame %d.\n", s.index);
+
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            }
+            return true;
+        }
+
+        /// Unmap slot s once the writers are done with it. If wait is false
+        /// and they are not, return false.
+
+        bool release(slot& s, bool wait)
+        {
+            if (s.map)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+
+                    if (s.busy && !wait)
+                        return false;
+
+                    space.wait(lock, [&]() { return !s.busy; });
+                    s.map = 0;
+                }
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            }
+            return true;
+        }
+
+        /// Writer thread. Pack each frame to 24 bits, release its slot, and
+        /// write it. Rows read by OpenGL are bottom-up, as Targa expects, so
+        /// no flip is needed.
+
+        void write()
+        {
+            for (;;)
+            {
+                job j;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    ready.wait(lock, [&]() { return !queue.empty() || !running; });
+
+                    if (queue.empty())
+                        return;
+
+                    j = queue.front();
+                    queue.pop_front();
+                }
+
+                char filename[1024];
+
+                snprintf(filename, sizeof (filename), name.c_str(), j.index);
+
+                void *p = malloc(size_t(j.w) * j.h * 3);
+
+                if (p)
+                    remove_alpha(p, j.p, size_t(j.w) * j.h);
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    j.s->busy = false;
+                }
+                space.notify_all();
+
+                if (p == 0 || write_tga(filename, j.w, j.h, 24, p))
+                    fprintf(stderr, "Failed to write '%s'.\n", filename);
+
+                free(p);
+            }
+        }
+
+        std::vector<std::unique_ptr<slot> > ring;
+        std::vector<std::thread>             writers;
+        std::deque<job>                      queue;
+        std::mutex                           mutex;
+        std::condition_variable              ready;
+        std::condition_variable              space;
+        std::string                          name;
+
+        int  limit;
+        int  head;
+        int  count;
+        bool running;
+    };
+}
+
+//------------------------------------------------------------------------------
+
+#endif
@@ -23,6 +23,9 @@
 
 #include <SDL.h>
 
+#include "GLCapture.hpp"
+#include "GLShader.hpp"
+
 //------------------------------------------------------------------------------
 
 namespace gl
@@ -81,7 +84,11 @@ namespace gl
                 if (b && SDL_WaitEvent(&e)) dispatch(e);
                 while   (SDL_PollEvent(&e)) dispatch(e);
 
+                if (shaders.poll())
+                    reload();
+
                 step();
+                upload();
                 draw();
                 swap();
             }
@@ -91,6 +98,10 @@ namespace gl
 
         virtual ~demonstration()
         {
+            recorder.stop();
+            shaders.clear();
+            frame.destroy();
+
             if (context) SDL_GL_DeleteContext(context);
             if (window)  SDL_DestroyWindow(window);
         }
@@ -120,16 +131,43 @@ namespace gl
             }
         }
 
+        /// Handle the replacement of programs rebuilt after their sources
+        /// changed, e.g. by querying uniform locations again.
+
+        virtual void reload()
+        {
+        }
+
+        /// Write the per-frame uniform block, bound at binding point 0 for
+        /// programs declaring it as follows.
+        ///
+        ///     layout(std140) uniform Frame
+        ///     {
+        ///         mat4 View;
+        ///         mat4 Projection;
+        ///         vec4 Light;
+        ///     };
+
+        virtual void upload()
+        {
+            uniform_packer p;
+
+            p.put(view()).put(projection()).put(light());
+
+            frame.write(p);
+        }
+
         /// Draw the scene.
 
         virtual void draw()
         {
         }
 
-        /// Swap buffers.
+        /// Swap buffers, capturing the frame first if recording.
 
         virtual void swap()
         {
+            recorder.frame(width, height);
             SDL_GL_SwapWindow(window);
         }
 
@@ -266,6 +304,10 @@ namespace gl
         SDL_Window   *window;
         SDL_GLContext context;
 
+        capture        recorder;
+        shader_watcher shaders;
+        uniform_ring   frame;
+
     private:
 
         bool drag_sun_rotation;
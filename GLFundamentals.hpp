@@ -42,6 +42,12 @@
 #include <cstring>
 #include <cstdio>
 #include <cmath>
+#include <string>
+#include <vector>
+
+#ifdef __AVX2__
+#  include <immintrin.h>
+#endif
 
 //------------------------------------------------------------------------------
 
@@ -223,6 +229,19 @@ namespace gl
         return radians * 57.2957795;
     }
 
+    /// Compute the 64-bit FNV-1a hash of n bytes at p, continuing from hash h.
+
+    inline unsigned long long hash(const void *p, size_t n,
+                                   unsigned long long h = 14695981039346656037ULL)
+    {
+        const unsigned char *c = (const unsigned char *) p;
+
+        for (size_t i = 0; i < n; i++)
+            h = (h ^ c[i]) * 1099511628211ULL;
+
+        return h;
+    }
+
     //--------------------------------------------------------------------------
 
     /// Calculate the 3-component negation of v.
@@ -592,9 +611,10 @@ namespace gl
     };
     #pragma pack(pop)
 
-    /// Write a 24 or 32-bit uncompressed true-color Targa image file. Receive
-    /// the raw pixel buffer in p and width, height, and depth in w, h, and d.
-    /// Return 0 on success and -1 on failure. Errno indicates the error.
+    /// Write an 8-bit grayscale or a 24 or 32-bit true-color uncompressed
+    /// Targa image file. Receive the raw pixel buffer in p and width, height,
+    /// and depth in w, h, and d. Return 0 on success and -1 on failure. Errno
+    /// indicates the error.
 
     inline int write_tga(const char *filename, int w, int h, int d, void *p)
     {
@@ -602,13 +622,13 @@ namespace gl
 
         memset(&head, 0, sizeof (tga_head));
 
-        head.image_type       = 2;
+        head.image_type       = (d == 8) ? 3 : 2;
         head.image_width      = (unsigned short) w;
         head.image_height     = (unsigned short) h;
         head.image_depth      = (unsigned  char) d;
         head.image_descriptor = (d == 32) ? 8 : 0;
 
-        if (d == 24 || d == 32)
+        if (d == 8 || d == 24 || d == 32)
         {
             if (FILE *stream = fopen(filename, "wb"))
             {
@@ -626,45 +646,420 @@ namespace gl
         return -1;
     }
 
-    /// Read a 24 or 32-bit uncompressed true-color Targa image file. Return a
-    /// pointer to the raw pixels. Give width, height, and depth in w, h, d.
-    /// Return null on failure.
+    /// The state of a run-length encoded Targa pixel stream, carried across
+    /// rows since packets may span them.
 
-    inline void *read_tga(const char *filename, int& w, int& h, int& d)
+    struct tga_rle
     {
-        tga_head head;
+        tga_rle() : k(0), run(false) { }
 
-        if (FILE *stream = fopen(filename, "rb"))
+        size_t        k;
+        bool          run;
+        unsigned char v[4];
+    };
+
+    /// Read the next n run-length encoded Targa pixels of s bytes each into
+    /// p. Return true on success.
+
+    inline bool read_tga_rle(FILE *stream, tga_rle& r, unsigned char *p,
+                             size_t n, int s)
+    {
+        for (size_t i = 0, k; i < n; i += k)
         {
-            if (fread(&head, sizeof (tga_head), 1, stream) == 1)
+            if (r.k == 0)
             {
-                if (head.image_type == 2)
+                const int c = fgetc(stream);
+
+                if (c == EOF)
+                    return false;
+
+                r.k   = size_t(c & 127) + 1;
+                r.run = (c & 128) != 0;
+
+                if (r.run && fread(r.v, s, 1, stream) != 1)
+                    return false;
+            }
+
+            k = (r.k < n - i) ? r.k : n - i;
+
+            if (r.run)
+                for (size_t j = 0; j < k; j++)
+                    memcpy(p + (i + j) * s, r.v, s);
+            else
+                if (fread(p + i * s, s, k, stream) != k)
+                    return false;
+
+            r.k -= k;
+        }
+        return true;
+    }
+
+    /// Expand n 8 or 16-bit indices at src through the table lut, of BGRA
+    /// words in memory order, into 24 or 32-bit pixels at dst. With AVX2, a
+    /// gather looks up eight pixels at a time.
+
+    inline void expand_tga_lut(unsigned char *dst, const unsigned char *src,
+                               size_t n, int s, int d, const unsigned int *lut)
+    {
+        const int c = d / 8;
+
+        size_t i = 0;
+#ifdef __AVX2__
+        const int *l = (const int *) lut;
+
+        if (d == 32)
+        {
+            if (s == 1)
+                for (; i + 8 <= n; i += 8)
                 {
-                    w = int(head.image_width);
-                    h = int(head.image_height);
-                    d = int(head.image_depth);
+                    __m128i k = _mm_loadl_epi64((const __m128i *) (src + i));
+                    __m256i x = _mm256_cvtepu8_epi32(k);
+
+                    _mm256_storeu_si256((__m256i *) (dst + 4 * i),
+                                        _mm256_i32gather_epi32(l, x, 4));
+                }
+            else
+                for (; i + 8 <= n; i += 8)
+                {
+                    __m128i k = _mm_loadu_si128((const __m128i *) (src + 2 * i));
+                    __m256i x = _mm256_cvtepu16_epi32(k);
+
+                    _mm256_storeu_si256((__m256i *) (dst + 4 * i),
+                                        _mm256_i32gather_epi32(l, x, 4));
+                }
+        }
+#endif
+        if (s == 1)
+            for (; i < n; i++)
+                memcpy(dst + c * i, lut + src[i], c);
+        else
+            for (; i < n; i++)
+                memcpy(dst + c * i, lut + (src[2 * i] | src[2 * i + 1] << 8), c);
+    }
 
-                    if (fseek(stream, head.id_length, SEEK_CUR) == 0)
+    /// Return the depth of the pixels decoded from a Targa image with the
+    /// given header, or 0 if the image is not supported. Color-map images of
+    /// 15, 16, 24, or 32-bit entries expand to 24 or 32 bits. True-color images of 15 or 16 bits are given
+    /// as stored, in 16-bit words. Grayscale images expand to 24 or 32 bits
+    /// unless gray is true, in which case they remain 8 or 16 bits.
+
+    inline int tga_depth(const tga_head& head, bool gray)
+    {
+        const int b = head.image_depth;
+
+        switch (head.image_type & ~8)
+        {
+        case 1:
+            if (head.color_map_type == 1 && (b == 8 || b == 16))
+                switch (head.color_map_size)
+                {
+                case 15:
+                case 16:
+                case 24: return 24;
+                case 32: return 32;
+                }
+            break;
+        case 2:
+            if (b == 15 || b == 16) return 16;
+            if (b == 24 || b == 32) return b;
+            break;
+        case 3:
+            if (b ==  8) return gray ?  8 : 24;
+            if (b == 16) return gray ? 16 : 32;
+            break;
+        }
+        return 0;
+    }
+
+    /// Decode the pixels of a Targa image with the given header, reading the
+    /// stream from just after that header. Write rows to p at intervals of
+    /// pitch bytes, in the order stored in the file. Return 0 on success and
+    /// -1 on failure.
+
+    inline int read_tga_data(FILE *stream, const tga_head& head, void *p,
+                             size_t pitch, bool gray)
+    {
+        const int  type = head.image_type & 7;
+        const bool rle  = head.image_type & 8;
+        const int  s    = (head.image_depth    + 7) / 8;
+        const int  m    = (head.color_map_size + 7) / 8;
+        const int  d    = tga_depth(head, gray);
+        const int  w    = head.image_width;
+        const int  h    = head.image_height;
+
+        unsigned int   *lut = 0;
+        unsigned char  *raw = 0;
+        unsigned char  *dst = (unsigned char *) p;
+
+        bool ok = d && fseek(stream, head.id_length, SEEK_CUR) == 0;
+
+        // Load the color map as BGRA words, or skip it if unused.
+
+        if (ok && head.color_map_type == 1)
+        {
+            if (type == 1)
+            {
+                const int n = 1 << head.image_depth;
+
+                lut = (unsigned int *) calloc(n, sizeof (unsigned int));
+                ok  = (lut != 0);
+
+                for (int i = 0; ok && i < head.color_map_length; i++)
+                {
+                    unsigned char e[4] = { 0, 0, 0, 0xFF };
+
+                    if ((ok = (fread(e, m, 1, stream) == 1)))
                     {
-                        if (void *p = calloc(w * h, d / 8))
+                        if (m == 2)
+                        {
+                            const int v = e[0] | e[1] << 8;
+                            const int b = (v      ) & 31;
+                            const int g = (v >>  5) & 31;
+                            const int r = (v >> 10) & 31;
+
+                            e[0] = (unsigned char) (b << 3 | b >> 2);
+                            e[1] = (unsigned char) (g << 3 | g >> 2);
+                            e[2] = (unsigned char) (r << 3 | r >> 2);
+                        }
+                        memcpy(lut + ((head.color_map_offset + i) & (n - 1)), e, 4);
+                    }
+                }
+            }
+            else ok = fseek(stream, long(m) * head.color_map_length,
+                            SEEK_CUR) == 0;
+        }
+
+        // Gray levels expand through a table of their own.
+
+        unsigned int g[256];
+
+        if (type == 3 && s == 1)
+            for (int i = 0; i < 256; i++)
+            {
+                const unsigned char e[4] = { (unsigned char) i,
+                                             (unsigned char) i,
+                                             (unsigned char) i, 0xFF };
+                memcpy(g + i, e, 4);
+            }
+
+        // Decode each row, directly into the destination if no expansion is
+        // needed and otherwise through a temporary row.
+
+        const bool direct = (d == 8 * s);
+
+        if (ok && !direct)
+            ok = (raw = (unsigned char *) malloc(size_t(w) * s)) != 0;
+
+        if (ok && direct && !rle && pitch == size_t(w) * s)
+            ok = fread(dst, size_t(w) * s, h, stream) == size_t(h);
+
+        else if (ok)
+        {
+            tga_rle r;
+
+            for (int y = 0; ok && y < h; y++)
+            {
+                unsigned char *q = dst + size_t(y) * pitch;
+                unsigned char *t = direct ? q : raw;
+
+                if (rle)
+                    ok = read_tga_rle(stream, r, t, w, s);
+                else
+                    ok = fread(t, s, w, stream) == size_t(w);
+
+                if (ok && !direct)
+                {
+                    if (type == 1)
+                        expand_tga_lut(q, t, w, s, d, lut);
+                    else if (type == 3 && s == 1)
+                        expand_tga_lut(q, t, w, s, d, g);
+                    else if (type == 3 && s == 2 && d == 32)
+                        for (int i = 0; i < w; i++)
                         {
-                            if (fread(p, d / 8, w * h, stream) == size_t(w * h))
-                            {
-                                fclose(stream);
-                                return p;
-                            }
+                            q[4 * i + 0] = t[2 * i];
+                            q[4 * i + 1] = t[2 * i];
+                            q[4 * i + 2] = t[2 * i];
+                            q[4 * i + 3] = t[2 * i + 1];
                         }
+                    else
+                        ok = false;
+                }
+            }
+        }
+
+        free(raw);
+        free(lut);
+        return ok ? 0 : -1;
+    }
+
+    /// Read the header of the named Targa image file. Give the width, height,
+    /// and depth that read_tga would return in w, h, and d, the Targa image
+    /// type in t, and true in top if the rows are stored top-down. Return 0
+    /// on success and -1 on failure or if the image is not supported.
+
+    inline int probe_tga(const char *filename, int& w, int& h, int& d,
+                         int& t, bool& top, bool gray = false)
+    {
+        tga_head head;
+        int      err = -1;
+
+        if (FILE *stream = fopen(filename, "rb"))
+        {
+            if (fread(&head, sizeof (tga_head), 1, stream) == 1)
+            {
+                w   = int(head.image_width);
+                h   = int(head.image_height);
+                d   = tga_depth(head, gray);
+                t   = int(head.image_type);
+                top = (head.image_descriptor & 0x20) != 0;
+
+                if (d)
+                    err = 0;
+            }
+            fclose(stream);
+        }
+        return err;
+    }
+
+    /// Decode the named Targa image file into caller-supplied buffer p with
+    /// rows pitch bytes apart. The buffer must hold the image dimensions
+    /// given by probe_tga. Return 0 on success and -1 on failure.
+
+    inline int read_tga_into(const char *filename, void *p, size_t pitch,
+                             bool gray = false)
+    {
+        tga_head head;
+        int      err = -1;
+
+        if (FILE *stream = fopen(filename, "rb"))
+        {
+            if (fread(&head, sizeof (tga_head), 1, stream) == 1)
+                err = read_tga_data(stream, head, p, pitch, gray);
+
+            fclose(stream);
+        }
+        return err;
+    }
+
+    /// Read a true-color (2, 10), grayscale (3, 11), or color-mapped (1, 9)
+    /// Targa image file, uncompressed or run-length encoded. Return a pointer
+    /// to the raw pixels. Give width, height, and depth in w, h, d. Color-map
+    /// images expand to 24 or 32 bits. Grayscale images expand to 24 or 32
+    /// bits unless gray is true, in which case they remain 8 or 16 bits and
+    /// are suitable for GL_R8 and GL_RG8. The buffer is obtained from alloc
+    /// and returned to release on failure. Return null on failure.
+
+    inline void *read_tga(const char *filename, int& w, int& h, int& d,
+                          bool gray = false,
+                          void *(*alloc)(size_t) = malloc,
+                          void  (*release)(void *) = free)
+    {
+        tga_head head;
+        void    *p = 0;
+
+        if (FILE *stream = fopen(filename, "rb"))
+        {
+            if (fread(&head, sizeof (tga_head), 1, stream) == 1)
+            {
+                w = int(head.image_width);
+                h = int(head.image_height);
+                d = tga_depth(head, gray);
+
+                if (d && (p = alloc(size_t(w) * h * (d / 8))))
+                {
+                    if (read_tga_data(stream, head, p, size_t(w) * (d / 8), gray))
+                    {
+                        release(p);
+                        p = 0;
                     }
                 }
             }
             fclose(stream);
         }
-        return 0;
+        return p;
     }
 
     //--------------------------------------------------------------------------
 
-    /// Load the named file into a newly-allocated buffer. Append nul.
+    /// A shader source compiled into the executable under the given name.
+
+    struct embedded_shader
+    {
+        const char *name;
+        const char *source;
+    };
+
+    struct embedded_state
+    {
+        const embedded_shader *table;
+        bool                   disk;
+
+        static embedded_state& get()
+        {
+            static embedded_state s = { 0, false };
+            return s;
+        }
+    };
+
+    /// Serve read_shader_source from the given table of embedded shaders,
+    /// ended by a null name, so that no shader file need be opened. If disk
+    /// is true, files on disk take precedence, for use during development.
+
+    inline void set_embedded_shaders(const embedded_shader *table,
+                                     bool disk = false)
+    {
+        embedded_state::get().table = table;
+        embedded_state::get().disk  = disk;
+    }
+
+    /// Return the given path with "." and "x/.." components removed.
+
+    inline std::string normalize_path(const std::string& path)
+    {
+        std::vector<std::string> v;
+        std::string              s;
+        size_t                   i = 0;
+
+        while (i <= path.size())
+        {
+            size_t j = path.find('/', i);
+
+            if (j == std::string::npos)
+                j = path.size();
+
+            std::string c = path.substr(i, j - i);
+
+            if (c == ".." && !v.empty() && v.back() != ".." && !v.back().empty())
+                v.pop_back();
+            else if (c != "." && (!c.empty() || v.empty()))
+                v.push_back(c);
+
+            i = j + 1;
+        }
+        for (size_t k = 0; k < v.size(); k++)
+            s += (k ? "/" : "") + v[k];
+
+        return s;
+    }
+
+    /// Return the embedded source of the given name, or null. The name is
+    /// normalized first, as are the names written by embed_shaders.
+
+    inline const char *get_embedded_shader(const char *name)
+    {
+        if (const embedded_shader *e = embedded_state::get().table)
+        {
+            const std::string s = normalize_path(name);
+
+            for (; e->name; e++)
+                if (s == e->name)
+                    return e->source;
+        }
+        return 0;
+    }
+
+    /// Load the named file into a newly-allocated buffer. Append nul. Use an
+    /// embedded shader of that name instead, if any, unless disk overrides.
 
     inline char *read_shader_source(const char *filename)
     {
@@ -672,7 +1067,12 @@ namespace gl
         void  *p = 0;
         size_t n = 0;
 
-        if ((stream = fopen(filename, "rb")))
+        const char *e = get_embedded_shader(filename);
+
+        if (e == 0 || embedded_state::get().disk)
+            stream = fopen(filename, "rb");
+
+        if (stream)
         {
             if (fseek(stream, 0, SEEK_END) == 0)
             {
@@ -689,6 +1089,11 @@ namespace gl
             }
             fclose(stream);
         }
+        else if (e)
+        {
+            if ((p = calloc(strlen(e) + 1, 1)))
+                strcpy((char *) p, e);
+        }
         else fprintf(stderr, "Failed to open '%s'.\n", filename);
 
         return (char *) p;
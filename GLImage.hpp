@@ -0,0 +1,1747 @@
+// Copyright (c) 2014 Robert Kooima
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef GLIMAGE_HPP
+#define GLIMAGE_HPP
+
+/// This header provides CPU-side processing of the raw pixel buffers returned
+/// by read_tga. Pixels are tightly packed 8-bit channels, d / 8 per pixel, in
+/// the channel order of the file. None of these functions require a context,
+/// except those that upload their results.
+///
+/// Work is spread across all available cores. SSE paths are used where the
+/// compiler enables them, and scalar code is used otherwise.
+
+//------------------------------------------------------------------------------
+
+#include "GLFundamentals.hpp"
+
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <vector>
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+#ifdef __SSSE3__
+#  include <tmmintrin.h>
+#endif
+#ifdef __F16C__
+#  include <immintrin.h>
+#endif
+
+//------------------------------------------------------------------------------
+
+namespace gl
+{
+    /// Call f(i) for each i in [0, n) using one thread per available core.
+    /// Indices are handed out in order but may complete in any order.
+
+    template <typename F> inline void parallel_for(int n, F f)
+    {
+        int k = int(std::thread::hardware_concurrency());
+
+        if (k > n) k = n;
+
+        if (k > 1)
+        {
+            std::atomic<int>         next(0);
+            std::vector<std::thread> pool;
+
+            for (int t = 0; t < k; t++)
+                pool.push_back(std::thread([&]()
+                {
+                    for (int i; (i = next++) < n; )
+                        f(i);
+                }));
+
+            for (int t = 0; t < k; t++)
+                pool[t].join();
+        }
+        else
+            for (int i = 0; i < n; i++)
+                f(i);
+    }
+
+    /// Call f(i0, i1) for consecutive bands of [0, n) in parallel. Bands hold
+    /// at least 64K items, so small inputs run on the calling thread.
+
+    template <typename F> inline void parallel_bands(size_t n, F f)
+    {
+        const size_t b = 65536;
+
+        parallel_for(int((n + b - 1) / b), [&](int i)
+        {
+            f(i * b, std::min(n, (i + 1) * b));
+        });
+    }
+
+    /// Return the GL pixel format of a raw Targa pixel buffer of depth d.
+
+    inline GLenum pixel_format(int d)
+    {
+        switch (d)
+        {
+            case  8: return GL_RED;
+            case 16: return GL_RG;
+            case 24: return GL_BGR;
+            case 32: return GL_BGRA;
+        }
+        return 0;
+    }
+
+    //--------------------------------------------------------------------------
+
+    /// Lookup tables mapping 8-bit sRGB to linear and linear back to 8-bit
+    /// sRGB. The inverse table is finely sampled so that it round-trips.
+
+    struct srgb_table
+    {
+        float         to_linear[256];
+        float         to_unorm [256];
+        unsigned char to_srgb[16384];
+
+        srgb_table()
+        {
+            for (int i = 0; i < 256; i++)
+            {
+                const double c = i / 255.0;
+
+                to_linear[i] = float(c <= 0.04045 ? c / 12.92
+                                     : pow((c + 0.055) / 1.055, 2.4));
+                to_unorm [i] = float(c);
+            }
+            for (int i = 0; i < 16384; i++)
+            {
+                const double l = i / 16383.0;
+                const double c = l <= 0.0031308 ? l * 12.92
+                               : 1.055 * pow(l, 1 / 2.4) - 0.055;
+
+                to_srgb[i] = (unsigned char) (c * 255.0 + 0.5);
+            }
+        }
+
+        static const srgb_table& get()
+        {
+            static const srgb_table table;
+            return table;
+        }
+    };
+
+    /// Quantize linear value l to 8 bits, sRGB-encoding it if s is true.
+
+    inline unsigned char quantize(float l, bool s)
+    {
+        if (l < 0.f) l = 0.f;
+        if (l > 1.f) l = 1.f;
+
+        if (s)
+            return srgb_table::get().to_srgb[int(l * 16383.f + 0.5f)];
+        else
+            return (unsigned char) (l * 255.f + 0.5f);
+    }
+
+    //--------------------------------------------------------------------------
+
+    /// A table of filter taps mapping n source samples onto m destination
+    /// samples. Each destination sample has the same number of taps, with
+    /// indices clamped to the edge and weights normalized to one.
+
+    struct filter_table
+    {
+        int                taps;
+        std::vector<int>   index;
+        std::vector<float> weight;
+
+        /// Build a table for kernel k with support radius r, measured in
+        /// destination samples when minifying and source samples otherwise.
+        /// A null kernel gives an exact area-weighted box.
+
+        filter_table(int n, int m, double (*k)(double), double r) : taps(0)
+        {
+            const double s = double(n) / double(m);
+            const double f = (s > 1) ? s : 1;
+            const double R = (k ? r : 0.5) * f;
+
+            taps = int(ceil(2 * R)) + 1;
+
+            index .resize(m * taps, 0);
+            weight.resize(m * taps, 0);
+
+            for (int x = 0; x < m; x++)
+            {
+                const double c  = (x + 0.5) * s;
+                const int    i0 = int(floor(c - R));
+                double       sum = 0;
+
+                for (int t = 0; t < taps; t++)
+                {
+                    const int i = i0 + t;
+                    double    w = 0;
+
+                    if (k)
+                        w = k((i + 0.5 - c) / f);
+                    else
+                    {
+                        const double a = std::max(double(i),     c - R);
+                        const double b = std::min(double(i + 1), c + R);
+                        w = (b > a) ? b - a : 0;
+                    }
+
+                    index [x * taps + t] = std::min(std::max(i, 0), n - 1);
+                    weight[x * taps + t] = float(w);
+                    sum += w;
+                }
+                if (sum != 0)
+                    for (int t = 0; t < taps; t++)
+                        weight[x * taps + t] = float(weight[x * taps + t] / sum);
+            }
+        }
+    };
+
+    /// Add w times the n values at src to the n values at dst.
+
+    inline void accumulate(float *dst, const float *src, float w, int n)
+    {
+        int i = 0;
+#ifdef __SSE2__
+        const __m128 k = _mm_set1_ps(w);
+
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i),
+                                   _mm_mul_ps(_mm_loadu_ps(src + i), k)));
+#endif
+        for (; i < n; i++)
+            dst[i] += src[i] * w;
+    }
+
+    //--------------------------------------------------------------------------
+
+    /// Filter selectors for resampling.
+
+    enum { filter_box, filter_kaiser, filter_mitchell, filter_lanczos };
+
+    /// Zeroth-order modified Bessel function of the first kind.
+
+    inline double bessel_i0(double x)
+    {
+        double s = 1, t = 1;
+
+        for (int k = 1; k < 32 && t > s * 1e-12; k++)
+        {
+            t *= (x * x) / (4.0 * k * k);
+            s += t;
+        }
+        return s;
+    }
+
+    /// Kaiser-windowed sinc with a support radius of 2 and alpha of 4.
+
+    inline double kaiser(double t)
+    {
+        const double r = 2, a = 4, pi = 3.14159265358979323846;
+
+        if (fabs(t) >= r) return 0;
+        if (fabs(t) < 1e-8) return 1;
+
+        const double u = t / r;
+        const double s = sin(pi * t) / (pi * t);
+
+        return s * bessel_i0(a * sqrt(1 - u * u)) / bessel_i0(a);
+    }
+
+    /// Mitchell-Netravali cubic with B = C = 1/3 and a support radius of 2.
+
+    inline double mitchell(double t)
+    {
+        const double B = 1.0 / 3.0, C = 1.0 / 3.0;
+
+        t = fabs(t);
+
+        if (t < 1)
+            return ((12 - 9 * B - 6 * C) * t * t * t
+                  + (-18 + 12 * B + 6 * C) * t * t
+                  + (6 - 2 * B)) / 6;
+        if (t < 2)
+            return ((-B - 6 * C) * t * t * t
+                  + (6 * B + 30 * C) * t * t
+                  + (-12 * B - 48 * C) * t
+                  + (8 * B + 24 * C)) / 6;
+        return 0;
+    }
+
+    /// Lanczos-windowed sinc with a support radius of 3.
+
+    inline double lanczos(double t)
+    {
+        const double pi = 3.14159265358979323846;
+
+        if (fabs(t) >= 3) return 0;
+        if (fabs(t) < 1e-8) return 1;
+
+        return 3 * sin(pi * t) * sin(pi * t / 3) / (pi * pi * t * t);
+    }
+
+    /// Return the kernel function and support radius of the given filter.
+    /// The box filter has a null kernel, meaning an exact area average.
+
+    inline double (*filter_kernel(int filter, double& r))(double)
+    {
+        switch (filter)
+        {
+            case filter_kaiser:   r = 2; return kaiser;
+            case filter_mitchell: r = 2; return mitchell;
+            case filter_lanczos:  r = 3; return lanczos;
+        }
+        r = 0.5;
+        return 0;
+    }
+
+    /// Resample a w by h image of c channels to dw by dh. Call load(y, row)
+    /// to get source row y as w * c floats, and store(y, row) to put output
+    /// row y of dw * c floats. Bands of output rows run in parallel, each
+    /// filtering only the source rows it needs horizontally, then combining
+    /// them vertically.
+
+    template <typename L, typename S>
+    inline void resample_rows(int w, int h, int dw, int dh, int c, int filter,
+                              L load, S store)
+    {
+        double r;
+        double (*k)(double) = filter_kernel(filter, r);
+
+        const filter_table X(w, dw, k, r);
+        const filter_table Y(h, dh, k, r);
+
+        const int b = 64;
+        const int n = dw * c;
+
+        parallel_for((dh + b - 1) / b, [&](int i)
+        {
+            const int y0 = i * b;
+            const int y1 = std::min(y0 + b, dh);
+
+            int lo = h, hi = 0;
+
+            for (int j = y0 * Y.taps; j < y1 * Y.taps; j++)
+                if (Y.weight[j])
+                {
+                    lo = std::min(lo, Y.index[j]);
+                    hi = std::max(hi, Y.index[j]);
+                }
+
+            std::vector<float> row(size_t(w) * c), acc(n);
+            std::vector<float> tmp(size_t(std::max(hi - lo + 1, 0)) * n);
+
+            // Filter the needed source rows horizontally.
+
+            for (int y = lo; y <= hi; y++)
+            {
+                float *q = &tmp[0] + size_t(y - lo) * n;
+
+                load(y, &row[0]);
+
+                for (int x = 0; x < dw; x++)
+                {
+                    const int   *I = &X.index [x * X.taps];
+                    const float *W = &X.weight[x * X.taps];
+#ifdef __SSE2__
+                    if (c == 4)
+                    {
+                        __m128 v = _mm_setzero_ps();
+
+                        for (int t = 0; t < X.taps; t++)
+                            v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(W[t]),
+                                              _mm_loadu_ps(&row[I[t] * 4])));
+
+                        _mm_storeu_ps(q + x * 4, v);
+                        continue;
+                    }
+#endif
+                    for (int e = 0; e < c; e++)
+                    {
+                        float v = 0;
+
+                        for (int t = 0; t < X.taps; t++)
+                            v += W[t] * row[I[t] * c + e];
+
+                        q[x * c + e] = v;
+                    }
+                }
+            }
+
+            // Combine them vertically into each output row.
+
+            for (int y = y0; y < y1; y++)
+            {
+                std::fill(acc.begin(), acc.end(), 0.f);
+
+                for (int t = 0; t < Y.taps; t++)
+                    if (const float wt = Y.weight[y * Y.taps + t])
+                        accumulate(&acc[0], &tmp[0] + size_t(Y.index[y * Y.taps + t]
+                                                             - lo) * n, wt, n);
+                store(y, &acc[0]);
+            }
+        });
+    }
+
+    /// Resample the w by h image src of depth d into the dw by dh buffer dst
+    /// using the given filter. If s is true, treat color channels as sRGB-
+    /// encoded and filter them in linear space. Alpha, the last of two or
+    /// four channels, is linear.
+
+    inline void resample(const void *src, int w,  int h,
+                               void *dst, int dw, int dh,
+                         int d, int filter = filter_mitchell, bool s = true)
+    {
+        const srgb_table& T = srgb_table::get();
+
+        const int c = d / 8;
+
+        const float *lut[4];
+        bool         enc[4];
+
+        for (int k = 0; k < c; k++)
+        {
+            enc[k] = s && !((c == 2 || c == 4) && k == c - 1);
+            lut[k] = enc[k] ? T.to_linear : T.to_unorm;
+        }
+
+        resample_rows(w, h, dw, dh, c, filter,
+            [&](int y, float *row)
+            {
+                const unsigned char *p = (const unsigned char *) src
+                                       + size_t(y) * w * c;
+                for (int i = 0; i < w; i++)
+                    for (int k = 0; k < c; k++)
+                        row[i * c + k] = lut[k][p[i * c + k]];
+            },
+            [&](int y, const float *row)
+            {
+                unsigned char *q = (unsigned char *) dst + size_t(y) * dw * c;
+
+                for (int i = 0; i < dw; i++)
+                    for (int k = 0; k < c; k++)
+                        q[i * c + k] = quantize(row[i * c + k], enc[k]);
+            });
+    }
+
+    /// Resample the w by h float image src of c channels into the dw by dh
+    /// buffer dst using the given filter.
+
+    inline void resample(const float *src, int w,  int h,
+                               float *dst, int dw, int dh,
+                         int c, int filter = filter_mitchell)
+    {
+        resample_rows(w, h, dw, dh, c, filter,
+            [&](int y, float *row)
+            {
+                memcpy(row, src + size_t(y) * w * c, sizeof (float) * w * c);
+            },
+            [&](int y, const float *row)
+            {
+                memcpy(dst + size_t(y) * dw * c, row, sizeof (float) * dw * c);
+            });
+    }
+
+    //--------------------------------------------------------------------------
+
+    /// Mipmap filter selectors.
+
+    enum { mipmap_box = filter_box, mipmap_kaiser = filter_kaiser };
+
+    /// Return the number of levels in a full mipmap chain of a w by h image.
+
+    inline int mipmap_levels(int w, int h)
+    {
+        int n = 1;
+
+        while ((w | h) >> n)
+            n++;
+
+        return n;
+    }
+
+    /// Return the width or height of level l of an image of width or height n.
+
+    inline int mipmap_dim(int n, int l)
+    {
+        return std::max(n >> l, 1);
+    }
+
+    /// Return the byte offset of level l within a mipmap chain of a w by h
+    /// image of depth d. Levels are tightly packed, largest first.
+
+    inline size_t mipmap_offset(int w, int h, int d, int l)
+    {
+        size_t o = 0;
+
+        for (int i = 0; i < l; i++)
+            o += size_t(mipmap_dim(w, i)) * size_t(mipmap_dim(h, i)) * (d / 8);
+
+        return o;
+    }
+
+    /// Downsample w by h image src of depth d into the dw by dh buffer dst.
+    /// If s is true, treat color channels as sRGB-encoded and filter them in
+    /// linear space. Alpha, the last of two or four channels, is linear.
+
+    inline void mipmap_reduce(const void *src, int w,  int h,
+                                    void *dst, int dw, int dh,
+                              int d, int filter = mipmap_box, bool s = true)
+    {
+        resample(src, w, h, dst, dw, dh, d, filter, s);
+    }
+
+    /// Generate a full mipmap chain for the w by h image p of depth d. Return
+    /// a newly-allocated buffer holding all levels, tightly packed, largest
+    /// first. Give the number of levels in n. Return null on failure.
+
+    inline void *make_mipmap(const void *p, int w, int h, int d, int& n,
+                             int filter = mipmap_box, bool s = true)
+    {
+        n = mipmap_levels(w, h);
+
+        if (unsigned char *q = (unsigned char *) malloc(mipmap_offset(w, h, d, n)))
+        {
+            memcpy(q, p, size_t(w) * size_t(h) * (d / 8));
+
+            for (int l = 1; l < n; l++)
+                mipmap_reduce(q + mipmap_offset(w, h, d, l - 1),
+                              mipmap_dim(w, l - 1), mipmap_dim(h, l - 1),
+                              q + mipmap_offset(w, h, d, l),
+                              mipmap_dim(w, l),     mipmap_dim(h, l),
+                              d, filter, s);
+            return q;
+        }
+        return 0;
+    }
+
+    /// Upload the n-level mipmap chain p of a w by h image of depth d to the
+    /// bound texture target using internal format i. Unpack alignment is
+    /// restored afterward.
+
+    inline void upload_mipmap(GLenum target, GLenum i, int w, int h, int d,
+                              int n, const void *p)
+    {
+        const GLubyte *q = (const GLubyte *) p;
+
+        GLint a = 4;
+
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &a);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        for (int l = 0; l < n; l++)
+            glTexImage2D(target, l, i, mipmap_dim(w, l), mipmap_dim(h, l), 0,
+                         pixel_format(d), GL_UNSIGNED_BYTE,
+                         q + mipmap_offset(w, h, d, l));
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, a);
+        glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, n - 1);
+    }
+
+    //--------------------------------------------------------------------------
+
+    /// Exchange the first and third channels of n pixels of depth d at p,
+    /// converting BGR to RGB or BGRA to RGBA and vice versa.
+
+    inline void swap_red_blue(void *p, size_t n, int d)
+    {
+        const int c = d / 8;
+
+        parallel_bands(n, [&](size_t i0, size_t i1)
+        {
+            unsigned char *q = (unsigned char *) p;
+            size_t i = i0 * c;
+            size_t e = i1 * c;
+#ifdef __SSSE3__
+            if (c == 4)
+            {
+                const __m128i m = _mm_setr_epi8(2, 1, 0, 3,  6,  5,  4,  7,
+                                               10, 9, 8, 11, 14, 13, 12, 15);
+                for (; i + 16 <= e; i += 16)
+                    _mm_storeu_si128((__m128i *) (q + i),
+                    _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (q + i)), m));
+            }
+            if (c == 3)
+            {
+                // Swap five pixels per step, leaving the sixteenth byte as-is.
+
+                const __m128i m = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7,
+                                                6, 11, 10, 9, 14, 13, 12, 15);
+                for (; i + 16 <= e; i += 15)
+                    _mm_storeu_si128((__m128i *) (q + i),
+                    _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (q + i)), m));
+            }
+#endif
+            for (; i + c <= e; i += c)
+                std::swap(q[i], q[i + 2]);
+        });
+    }
+
+    /// Expand n 24-bit pixels at src to 32-bit pixels at dst with opaque alpha.
+
+    inline void expand_alpha(void *dst, const void *src, size_t n)
+    {
+        parallel_bands(n, [&](size_t i0, size_t i1)
+        {
+            const unsigned char *s = (const unsigned char *) src;
+                  unsigned char *d = (unsigned char *) dst;
+            size_t i = i0;
+#ifdef __SSSE3__
+            const __m128i m = _mm_setr_epi8(0, 1,  2, -1, 3,  4,  5, -1,
+                                            6, 7,  8, -1, 9, 10, 11, -1);
+            const __m128i a = _mm_set1_epi32(0xFF000000);
+
+            for (; i + 6 <= i1; i += 4)
+                _mm_storeu_si128((__m128i *) (d + i * 4), _mm_or_si128(a,
+                _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (s + i * 3)), m)));
+#endif
+            for (; i < i1; i++)
+            {
+                d[i * 4 + 0] = s[i * 3 + 0];
+                d[i * 4 + 1] = s[i * 3 + 1];
+                d[i * 4 + 2] = s[i * 3 + 2];
+                d[i * 4 + 3] = 0xFF;
+            }
+        });
+    }
+
+    /// Pack n 32-bit pixels at src to 24-bit pixels at dst, dropping alpha.
+
+    inline void remove_alpha(void *dst, const void *src, size_t n)
+    {
+        parallel_bands(n, [&](size_t i0, size_t i1)
+        {
+            const unsigned char *s = (const unsigned char *) src;
+                  unsigned char *d = (unsigned char *) dst;
+            size_t i = i0;
+#ifdef __SSSE3__
+            const __m128i m = _mm_setr_epi8(0, 1,  2,  4,  5,  6,  8,  9,
+                                           10, 12, 13, 14, -1, -1, -1, -1);
+
+            // Each store spills four bytes into the next pixels, which the
+            // following step overwrites, so stop short of the band's end.
+
+            for (; i + 6 <= i1; i += 4)
+                _mm_storeu_si128((__m128i *) (d + i * 3),
+                _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (s + i * 4)), m));
+#endif
+            for (; i < i1; i++)
+            {
+                d[i * 3 + 0] = s[i * 4 + 0];
+                d[i * 3 + 1] = s[i * 4 + 1];
+                d[i * 3 + 2] = s[i * 4 + 2];
+            }
+        });
+    }
+
+    /// Flip the w by h image p of depth d vertically in place, converting a
+    /// top-down Targa to the bottom-up row order of OpenGL.
+
+    inline void flip_rows(void *p, int w, int h, int d)
+    {
+        const size_t n = size_t(w) * (d / 8);
+
+        parallel_for(h / 2, [&](int y)
+        {
+            unsigned char *a = (unsigned char *) p + size_t(y)         * n;
+            unsigned char *b = (unsigned char *) p + size_t(h - 1 - y) * n;
+
+            std::swap_ranges(a, a + n, b);
+        });
+    }
+
+    /// Multiply the color of n 32-bit pixels at p by their alpha.
+
+    inline void premultiply_alpha(void *p, size_t n)
+    {
+        parallel_bands(n, [&](size_t i0, size_t i1)
+        {
+            unsigned char *q = (unsigned char *) p;
+            size_t i = i0;
+#ifdef __SSE2__
+            const __m128i z   = _mm_setzero_si128();
+            const __m128i rgb = _mm_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0);
+            const __m128i one = _mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255);
+            const __m128i r   = _mm_set1_epi16(128);
+
+            // Compute c * a / 255, rounded, in 16-bit lanes, two pixels per half.
+
+            for (; i + 4 <= i1; i += 4)
+            {
+                __m128i v = _mm_loadu_si128((__m128i *) (q + i * 4));
+                __m128i h[2] = { _mm_unpacklo_epi8(v, z),
+                                 _mm_unpackhi_epi8(v, z) };
+
+                for (int k = 0; k < 2; k++)
+                {
+                    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(h[k],
+                                    _MM_SHUFFLE(3, 3, 3, 3)),
+                                    _MM_SHUFFLE(3, 3, 3, 3));
+                    a = _mm_or_si128(_mm_and_si128(a, rgb), one);
+
+                    __m128i t = _mm_add_epi16(_mm_mullo_epi16(h[k], a), r);
+                    h[k] = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+                }
+                _mm_storeu_si128((__m128i *) (q + i * 4), _mm_packus_epi16(h[0], h[1]));
+            }
+#endif
+            for (; i < i1; i++)
+                for (int k = 0; k < 3; k++)
+                {
+                    const int t = q[i * 4 + k] * q[i * 4 + 3] + 128;
+                    q[i * 4 + k] = (unsigned char) ((t + (t >> 8)) >> 8);
+                }
+        });
+    }
+
+    /// Divide the color of n 32-bit pixels at p by their alpha, multiplying
+    /// by a table of 16.16 fixed-point reciprocals. With SSE2 each product is
+    /// formed from the high and low halves of the reciprocal in 16-bit lanes.
+
+    inline void unpremultiply_alpha(void *p, size_t n)
+    {
+        static struct table
+        {
+            unsigned int   r[256];
+            unsigned short h[256][4];
+            unsigned short l[256][4];
+
+            table()
+            {
+                for (int a = 0; a < 256; a++)
+                {
+                    r[a] = a ? (255 * 65536 + a / 2) / a : 0;
+
+                    // Alpha is multiplied by one.
+
+                    h[a][0] = h[a][1] = h[a][2] = (unsigned short) (r[a] >> 16);
+                    l[a][0] = l[a][1] = l[a][2] = (unsigned short) (r[a]);
+                    h[a][3] = 1;
+                    l[a][3] = 0;
+                }
+            }
+        } T;
+
+        parallel_bands(n, [&](size_t i0, size_t i1)
+        {
+            unsigned char *q = (unsigned char *) p;
+            size_t i = i0;
+#ifdef __SSE2__
+            const __m128i z   = _mm_setzero_si128();
+            const __m128i top = _mm_set1_epi16(255);
+
+            // Compute (c * r + 32768) >> 16 as c * h + mulhi(c, l) plus the
+            // rounding bit of mullo(c, l), clamped to 255.
+
+            for (; i + 4 <= i1; i += 4)
+            {
+                __m128i v = _mm_loadu_si128((__m128i *) (q + i * 4));
+                __m128i c[2] = { _mm_unpacklo_epi8(v, z),
+                                 _mm_unpackhi_epi8(v, z) };
+
+                for (int k = 0; k < 2; k++)
+                {
+                    const unsigned char *e = q + (i + 2 * k) * 4;
+
+                    __m128i h = _mm_unpacklo_epi64(
+                                    _mm_loadl_epi64((__m128i *) T.h[e[3]]),
+                                    _mm_loadl_epi64((__m128i *) T.h[e[7]]));
+                    __m128i l = _mm_unpacklo_epi64(
+                                    _mm_loadl_epi64((__m128i *) T.l[e[3]]),
+                                    _mm_loadl_epi64((__m128i *) T.l[e[7]]));
+
+                    __m128i t = _mm_add_epi16(_mm_mullo_epi16(c[k], h),
+                                _mm_add_epi16(_mm_mulhi_epu16(c[k], l),
+                                _mm_srli_epi16(_mm_mullo_epi16(c[k], l), 15)));
+
+                    c[k] = _mm_sub_epi16(t, _mm_subs_epu16(t, top));
+                }
+                _mm_storeu_si128((__m128i *) (q + i * 4), _mm_packus_epi16(c[0], c[1]));
+            }
+#endif
+            for (; i < i1; i++)
+            {
+                const unsigned int r = T.r[q[i * 4 + 3]];
+
+                for (int k = 0; k < 3; k++)
+                    q[i * 4 + k] = (unsigned char)
+                        std::min((q[i * 4 + k] * r + 32768) >> 16, 255u);
+            }
+        });
+    }
+
+    //--------------------------------------------------------------------------
+
+    /// The result of comparing two images: the mean squared difference over
+    /// all channels, the peak signal-to-noise ratio in dB (infinite if equal),
+    /// the largest channel difference, and the number of failing pixels.
+
+    struct image_diff
+    {
+        double mse;
+        double psnr;
+        int    max;
+        size_t count;
+    };
+
+    /// Write the absolute difference of n bytes at a and b to c. Return the
+    /// sum of their squares.
+
+    inline unsigned long long absdiff(const unsigned char *a,
+                                      const unsigned char *b,
+                                            unsigned char *c, size_t n)
+    {
+        unsigned long long s = 0;
+        size_t i = 0;
+#ifdef __SSE2__
+        const __m128i z = _mm_setzero_si128();
+
+        while (i + 16 <= n)
+        {
+            // Accumulate 32-bit sums in blocks short enough not to overflow.
+
+            __m128i t = z;
+
+            for (size_t e = std::min(n, i + 4096); i + 16 <= e; i += 16)
+            {
+                const __m128i x = _mm_loadu_si128((const __m128i *) (a + i));
+                const __m128i y = _mm_loadu_si128((const __m128i *) (b + i));
+                const __m128i v = _mm_or_si128(_mm_subs_epu8(x, y),
+                                               _mm_subs_epu8(y, x));
+                const __m128i l = _mm_unpacklo_epi8(v, z);
+                const __m128i h = _mm_unpackhi_epi8(v, z);
+
+                _mm_storeu_si128((__m128i *) (c + i), v);
+
+                t = _mm_add_epi32(t, _mm_add_epi32(_mm_madd_epi16(l, l),
+                                                   _mm_madd_epi16(h, h)));
+            }
+
+            unsigned int u[4];
+            _mm_storeu_si128((__m128i *) u, t);
+            s += (unsigned long long) u[0] + u[1] + u[2] + u[3];
+        }
+#endif
+        for (; i < n; i++)
+        {
+            c[i] = (unsigned char) (a[i] > b[i] ? a[i] - b[i] : b[i] - a[i]);
+            s   += c[i] * c[i];
+        }
+        return s;
+    }
+
+    /// Return the approximate luma of pixel x of Targa pixel row p of c channels.
+
+    inline int luma(const unsigned char *p, int x, int c)
+    {
+        return (c < 3) ? p[x * c]
+                       : (p[x * c] + 5 * p[x * c + 1] + 2 * p[x * c + 2]) / 8;
+    }
+
+    /// Compare w by h images a and b of depth d. A pixel fails if any channel
+    /// differs by more than tol plus masking times the local contrast of a,
+    /// so that differences along edges, which are less visible, count less.
+    /// If heat is not null, write a 24-bit heatmap to it showing failures in
+    /// yellow to red over a dimmed copy of a. If mt is true, rows are spread
+    /// over all cores.
+
+    inline void compare_images(const void *a, const void *b, int w, int h,
+                               int d, image_diff& r, int tol = 0,
+                               float masking = 0.25f, void *heat = 0,
+                               bool mt = true)
+    {
+        const int    c = d / 8;
+        const size_t n = size_t(w) * c;
+
+        const unsigned char *A = (const unsigned char *) a;
+        const unsigned char *B = (const unsigned char *) b;
+              unsigned char *H = (      unsigned char *) heat;
+
+        std::vector<unsigned long long> sum(h, 0);
+        std::vector<size_t>             cnt(h, 0);
+        std::vector<int>                top(h, 0);
+
+        auto row = [&](int y)
+        {
+            const unsigned char *p = A + y * n;
+            const unsigned char *q = B + y * n;
+
+            std::vector<unsigned char> v(n);
+
+            sum[y] = absdiff(p, q, &v[0], n);
+
+            for (int x = 0; x < w; x++)
+            {
+                int m = 0;
+
+                for (int k = 0; k < c; k++)
+                    m = std::max(m, int(v[x * c + k]));
+
+                top[y] = std::max(top[y], m);
+
+                bool fail = false;
+
+                if (m > tol)
+                {
+                    float t = float(tol);
+
+                    if (masking > 0)
+                    {
+                        int lo = 255, hi = 0;
+
+                        for (int j = std::max(y - 1, 0); j <= std::min(y + 1, h - 1); j++)
+                            for (int i = std::max(x - 1, 0); i <= std::min(x + 1, w - 1); i++)
+                            {
+                                const int l = luma(A + j * n, i, c);
+                                lo = std::min(lo, l);
+                                hi = std::max(hi, l);
+                            }
+                        t += masking * (hi - lo);
+                    }
+                    if (m > t)
+                    {
+                        cnt[y]++;
+                        fail = true;
+                    }
+                }
+
+                if (H)
+                {
+                    unsigned char *o = H + (size_t(y) * w + x) * 3;
+
+                    if (fail)
+                    {
+                        o[0] = 0;
+                        o[1] = (unsigned char) (255 - std::min(255, 4 * m));
+                        o[2] = 255;
+                    }
+                    else
+                        o[0] = o[1] = o[2] = (unsigned char) (luma(p, x, c) / 4);
+                }
+            }
+        };
+
+        if (mt)
+            parallel_for(h, row);
+        else
+            for (int y = 0; y < h; y++)
+                row(y);
+
+        unsigned long long s = 0;
+
+        r.count = 0;
+        r.max   = 0;
+
+        for (int y = 0; y < h; y++)
+        {
+            s       += sum[y];
+            r.count += cnt[y];
+            r.max    = std::max(r.max, top[y]);
+        }
+
+        r.mse  = double(s) / (double(n) * h);
+        r.psnr = (s == 0) ? HUGE_VAL : 10.0 * log10(255.0 * 255.0 / r.mse);
+    }
+
+    /// Compare the named Targa files. If heatname is not null, write a heatmap
+    /// there. Return 0 on success and -1 if either file fails to load or if
+    /// their sizes or depths differ.
+
+    inline int compare_tga(const char *a, const char *b, image_diff& r,
+                           int tol = 0, float masking = 0.25f,
+                           const char *heatname = 0, bool mt = true)
+    {
+        int   err = -1, aw, ah, ad, bw, bh, bd;
+        void *ap  = read_tga(a, aw, ah, ad);
+        void *bp  = read_tga(b, bw, bh, bd);
+
+        if (ap && bp && aw == bw && ah == bh && ad == bd)
+        {
+            void *hp = heatname ? malloc(size_t(aw) * ah * 3) : 0;
+
+            compare_images(ap, bp, aw, ah, ad, r, tol, masking, hp, mt);
+
+            err = (heatname && (!hp || write_tga(heatname, aw, ah, 24, hp)))
+                ? -1 : 0;
+            free(hp);
+        }
+        free(bp);
+        free(ap);
+        return err;
+    }
+
+    /// Compare n pairs of named Targa files, one pair per core, giving the
+    /// results in r and the status of each in e. Return the number of pairs
+    /// that could not be compared.
+
+    inline int compare_tga(int n, const char *const *a, const char *const *b,
+                           image_diff *r, int *e, int tol = 0,
+                           float masking = 0.25f)
+    {
+        std::atomic<int> f(0);
+
+        parallel_for(n, [&](int i)
+        {
+            if ((e[i] = compare_tga(a[i], b[i], r[i], tol, masking, 0, false)))
+                f++;
+        });
+        return f;
+    }
+
+    //--------------------------------------------------------------------------
+
+    /// Convert a 32-bit float to a 16-bit half float, rounding to nearest even.
+
+    inline unsigned short to_half(float f)
+    {
+        unsigned int x;
+
+        memcpy(&x, &f, sizeof (x));
+
+        const unsigned int s = (x >> 16) & 0x8000;
+        const int          e = int((x >> 23) & 0xFF) - 112;
+              unsigned int m = x & 0x7FFFFF;
+
+        if (((x >> 23) & 0xFF) == 0xFF)
+            return (unsigned short) (s | 0x7C00 | (m ? 0x200 : 0));
+
+        if (e >= 31)
+            return (unsigned short) (s | 0x7C00);
+
+        if (e <= 0)
+        {
+            if (e < -10)
+                return (unsigned short) s;
+
+            const int          n = 14 - e;
+            const unsigned int M = m | 0x800000;
+                  unsigned int h = M >> n;
+            const unsigned int r = M & ((1u << n) - 1);
+            const unsigned int t = 1u << (n - 1);
+
+            if (r > t || (r == t && (h & 1)))
+                h++;
+
+            return (unsigned short) (s | h);
+        }
+
+        unsigned int h = (unsigned int) e << 10 | m >> 13;
+
+        if ((m & 0x1FFF) > 0x1000 || ((m & 0x1FFF) == 0x1000 && (h & 1)))
+            h++;
+
+        return (unsigned short) (s | h);
+    }
+
+    /// Convert a 16-bit half float to a 32-bit float.
+
+    inline float from_half(unsigned short h)
+    {
+        const unsigned int s = (h & 0x8000u) << 16;
+              int          e = (h >> 10) & 31;
+              unsigned int m =  h & 0x3FF;
+              unsigned int x;
+
+        if (e == 0)
+        {
+            if (m == 0)
+                x = s;
+            else
+            {
+                for (e = 1; (m & 0x400) == 0; e--)
+                    m <<= 1;
+
+                x = s | unsigned(e + 112) << 23 | (m & 0x3FF) << 13;
+            }
+        }
+        else if (e == 31)
+            x = s | 0x7F800000 | m << 13;
+        else
+            x = s | unsigned(e + 112) << 23 | m << 13;
+
+        float f;
+        memcpy(&f, &x, sizeof (f));
+        return f;
+    }
+
+    /// Convert n floats at src to half floats at dst, using F16C if enabled.
+
+    inline void float_to_half(unsigned short *dst, const float *src, size_t n)
+    {
+        parallel_bands(n, [&](size_t i0, size_t i1)
+        {
+            size_t i = i0;
+#ifdef __F16C__
+            for (; i + 4 <= i1; i += 4)
+                _mm_storel_epi64((__m128i *) (dst + i),
+                    _mm_cvtps_ph(_mm_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+            for (; i < i1; i++)
+                dst[i] = to_half(src[i]);
+        });
+    }
+
+    /// Convert n half floats at src to floats at dst, using F16C if enabled.
+
+    inline void half_to_float(float *dst, const unsigned short *src, size_t n)
+    {
+        parallel_bands(n, [&](size_t i0, size_t i1)
+        {
+            size_t i = i0;
+#ifdef __F16C__
+            for (; i + 4 <= i1; i += 4)
+                _mm_storeu_ps(dst + i,
+                    _mm_cvtph_ps(_mm_loadl_epi64((const __m128i *) (src + i))));
+#endif
+            for (; i < i1; i++)
+                dst[i] = from_half(src[i]);
+        });
+    }
+
+    /// Upload the w by h float image p with c channels in RGB order to the
+    /// given level of the bound texture target as half floats. Unpack
+    /// alignment is restored afterward. Images with other than 1 to 4
+    /// channels are ignored.
+
+    inline void upload_half(GLenum target, GLint level, int w, int h, int c,
+                            const float *p)
+    {
+        static const GLenum i[4] = { GL_R16F, GL_RG16F, GL_RGB16F, GL_RGBA16F };
+        static const GLenum f[4] = { GL_RED,  GL_RG,    GL_RGB,    GL_RGBA    };
+
+        if (c < 1 || c > 4)
+            return;
+
+        const size_t n = size_t(w) * h * c;
+
+        if (unsigned short *q = (unsigned short *) malloc(n * sizeof (unsigned short)))
+        {
+            GLint a = 4;
+
+            float_to_half(q, p, n);
+
+            glGetIntegerv(GL_UNPACK_ALIGNMENT, &a);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+            glTexImage2D(target, level, i[c - 1], w, h, 0, f[c - 1],
+                         GL_HALF_FLOAT, q);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, a);
+            free(q);
+        }
+    }
+
+    //--------------------------------------------------------------------------
+
+    /// Read a Portable Float Map image file. Return a pointer to the float
+    /// pixels in RGB order, bottom row first. Give width, height, and number
+    /// of channels (1 or 3) in w, h, and c. Return null on failure.
+
+    inline float *read_pfm(const char *filename, int& w, int& h, int& c)
+    {
+        float *p = 0;
+
+        if (FILE *stream = fopen(filename, "rb"))
+        {
+            char   t = 0;
+            double k = 0;
+
+            if (fscanf(stream, "P%c %d %d %lf", &t, &w, &h, &k) == 4
+                && (t == 'F' || t == 'f') && w > 0 && h > 0 && fgetc(stream) != EOF)
+            {
+                const size_t n = size_t(w) * h * (c = (t == 'F') ? 3 : 1);
+
+                if ((p = (float *) malloc(n * sizeof (float))))
+                {
+                    if (fread(p, sizeof (float), n, stream) == n)
+                    {
+                        // Swap bytes if the file order differs from ours.
+
+                        const unsigned int one = 1;
+                        const bool little = *(const unsigned char *) &one == 1;
+
+                        if ((k < 0) != little)
+                            for (size_t i = 0; i < n; i++)
+                            {
+                                unsigned char *b = (unsigned char *) (p + i);
+                                std::swap(b[0], b[3]);
+                                std::swap(b[1], b[2]);
+                            }
+                    }
+                    else
+                    {
+                        free(p);
+                        p = 0;
+                    }
+                }
+            }
+            fclose(stream);
+        }
+        return p;
+    }
+
+    /// Write a Portable Float Map image file of w by h float pixels p with 1
+    /// or 3 channels c, bottom row first. Return 0 on success and -1 on
+    /// failure.
+
+    inline int write_pfm(const char *filename, int w, int h, int c,
+                         const float *p)
+    {
+        const unsigned int one = 1;
+        const bool little = *(const unsigned char *) &one == 1;
+        const size_t n = size_t(w) * h * c;
+
+        if (c == 1 || c == 3)
+        {
+            if (FILE *stream = fopen(filename, "wb"))
+            {
+                if (fprintf(stream, "P%c\n%d %d\n%s\n", c == 3 ? 'F' : 'f',
+                            w, h, little ? "-1.0" : "1.0") > 0 &&
+                    fwrite(p, sizeof (float), n, stream) == n)
+                {
+                    fclose(stream);
+                    return 0;
+                }
+                fclose(stream);
+            }
+        }
+        return -1;
+    }
+
+    /// Read a Radiance RGBE image file, flat or run-length encoded. Return a
+    /// pointer to the RGB float pixels, bottom row first, as with read_tga.
+    /// Give the width and height in w and h. Return null on failure.
+
+    inline float *read_hdr(const char *filename, int& w, int& h)
+    {
+        float *p = 0;
+
+        if (FILE *stream = fopen(filename, "rb"))
+        {
+            char line[256];
+            bool ok = fgets(line, sizeof (line), stream) && line[0] == '#'
+                                                        && line[1] == '?';
+
+            // Skip the header down to the blank line and read the resolution.
+
+            while (ok && (ok = fgets(line, sizeof (line), stream) != 0))
+                if (line[0] == '\n' || line[0] == '\r')
+                    break;
+
+            ok = ok && fscanf(stream, "-Y %d +X %d", &h, &w) == 2
+                    && fgetc(stream) == '\n' && w > 0 && h > 0;
+
+            if (ok && (p = (float *) malloc(size_t(w) * h * 3 * sizeof (float))))
+            {
+                std::vector<unsigned char> row(size_t(w) * 4);
+
+                for (int y = 0; ok && y < h; y++)
+                {
+                    unsigned char *r = &row[0];
+
+                    if ((ok = fread(r, 4, 1, stream) == 1))
+                    {
+                        if (r[0] == 2 && r[1] == 2 && (r[2] << 8 | r[3]) == w
+                                      && w >= 8 && w < 32768)
+                        {
+                            // Decode four channel planes of runs and literals.
+
+                            for (int k = 0; ok && k < 4; k++)
+                                for (int x = 0; ok && x < w; )
+                                {
+                                    int n = fgetc(stream), v;
+
+                                    if ((ok = n > 0))
+                                    {
+                                        if (n > 128)
+                                        {
+                                            n -= 128;
+                                            if ((ok = (x + n <= w &&
+                                                 (v = fgetc(stream)) != EOF)))
+                                                for (; n; n--)
+                                                    r[4 * x++ + k] = (unsigned char) v;
+                                        }
+                                        else if ((ok = x + n <= w))
+                                            for (; ok && n; n--)
+                                                if ((ok = (v = fgetc(stream)) != EOF))
+                                                    r[4 * x++ + k] = (unsigned char) v;
+                                    }
+                                }
+                        }
+                        else ok = fread(r + 4, 4, w - 1, stream) == size_t(w - 1);
+                    }
+
+                    // Convert shared-exponent pixels into a bottom-up row.
+
+                    float *q = p + size_t(h - 1 - y) * w * 3;
+
+                    for (int x = 0; ok && x < w; x++)
+                    {
+                        const unsigned char *e = r + 4 * x;
+                        const float f = e[3] ? float(ldexp(1.0, e[3] - 136)) : 0.f;
+
+                        q[3 * x + 0] = e[3] ? (e[0] + 0.5f) * f : 0.f;
+                        q[3 * x + 1] = e[3] ? (e[1] + 0.5f) * f : 0.f;
+                        q[3 * x + 2] = e[3] ? (e[2] + 0.5f) * f : 0.f;
+                    }
+                }
+                if (!ok)
+                {
+                    free(p);
+                    p = 0;
+                }
+            }
+            fclose(stream);
+        }
+        return p;
+    }
+
+    /// Write a flat Radiance RGBE image file of w by h RGB float pixels p,
+    /// bottom row first. Return 0 on success and -1 on failure.
+
+    inline int write_hdr(const char *filename, int w, int h, const float *p)
+    {
+        int err = -1;
+
+        if (FILE *stream = fopen(filename, "wb"))
+        {
+            if (fprintf(stream, "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n"
+                                "-Y %d +X %d\n", h, w) > 0)
+            {
+                std::vector<unsigned char> row(size_t(w) * 4);
+
+                err = 0;
+
+                for (int y = h - 1; err == 0 && y >= 0; y--)
+                {
+                    const float *q = p + size_t(y) * w * 3;
+
+                    for (int x = 0; x < w; x++)
+                    {
+                        const float v = std::max(std::max(q[3 * x], q[3 * x + 1]),
+                                                                    q[3 * x + 2]);
+                        unsigned char *e = &row[4 * x];
+                        int k;
+
+                        if (v < 1e-32f)
+                            e[0] = e[1] = e[2] = e[3] = 0;
+                        else
+                        {
+                            const float s = float(frexp(v, &k) * 256.0 / v);
+
+                            e[0] = (unsigned char) std::max(q[3 * x + 0] * s, 0.f);
+                            e[1] = (unsigned char) std::max(q[3 * x + 1] * s, 0.f);
+                            e[2] = (unsigned char) std::max(q[3 * x + 2] * s, 0.f);
+                            e[3] = (unsigned char) (k + 128);
+                        }
+                    }
+                    if (fwrite(&row[0], 4, w, stream) != size_t(w))
+                        err = -1;
+                }
+            }
+            fclose(stream);
+        }
+        return err;
+    }
+
+    /// Tone-map the w by h float image p with c channels in RGB order and
+    /// write it as an 8-bit grayscale or 24-bit Targa image file. A missing
+    /// blue channel is written as zero and alpha is dropped. Scale by
+    /// exposure, compress with x / (1 + x), and encode as sRGB. Rows are
+    /// processed in parallel bands and written as they complete, so no full
+    /// 8-bit copy is made. Return 0 on success and -1 on failure.
+
+    inline int write_tonemapped_tga(const char *filename, int w, int h, int c,
+                                    const float *p, float exposure = 1.f)
+    {
+        if (c < 1 || c > 4)
+            return -1;
+
+        const int d = (c == 1) ? 8 : 24;
+        const int o = d / 8;
+        const int b = 64;
+
+        tga_head head;
+
+        memset(&head, 0, sizeof (tga_head));
+
+        head.image_type   = (d == 8) ? 3 : 2;
+        head.image_width  = (unsigned short) w;
+        head.image_height = (unsigned short) h;
+        head.image_depth  = (unsigned  char) d;
+
+        int err = -1;
+
+        if (FILE *stream = fopen(filename, "wb"))
+        {
+            if (fwrite(&head, sizeof (tga_head), 1, stream) == 1)
+            {
+                std::vector<unsigned char> band(size_t(w) * o * b);
+
+                err = 0;
+
+                for (int y0 = 0; err == 0 && y0 < h; y0 += b)
+                {
+                    const int n = std::min(b, h - y0);
+
+                    parallel_for(n, [&](int y)
+                    {
+                        const float   *s = p + size_t(y0 + y) * w * c;
+                        unsigned char *t = &band[0] + size_t(y) * w * o;
+
+                        for (int x = 0; x < w; x++)
+                            for (int k = 0; k < o; k++)
+                            {
+                                const int i = (o == 1) ? 0 : 2 - k;
+
+                                const float v = (i < c) ? s[x * c + i]
+                                                        * exposure : 0.f;
+
+                                t[x * o + k] = quantize(v / (1.f + v), true);
+                            }
+                    });
+
+                    if (fwrite(&band[0], size_t(w) * o, n, stream) != size_t(n))
+                        err = -1;
+                }
+            }
+            fclose(stream);
+        }
+        return err;
+    }
+
+    //--------------------------------------------------------------------------
+
+    /// Normal map gradient kernels and edge modes.
+
+    enum { normal_sobel, normal_scharr };
+    enum { wrap_clamp, wrap_repeat };
+
+    /// Compute a tangent-space normal map of the w by h height image src of
+    /// depth d and store it in dst. Height is the luma of color images and
+    /// the first channel of others. Slopes are scaled by strength. Edges are
+    /// clamped or repeated, the latter for tiling textures. If od is 24 the
+    /// output is packed BGR, as written by write_tga. If od is 16 it is the
+    /// red and green of the normal only, ready for compress_bc with bc5, and
+    /// blue must be rebuilt from them when sampled. Green points up the image
+    /// as drawn by GL. Bands of rows are converted and filtered in parallel,
+    /// four pixels at a time where SSE is enabled.
+
+    inline void make_normal_map(const void *src, int w, int h, int d,
+                                      void *dst, int od, float strength,
+                                int kernel = normal_sobel, int wrap = wrap_clamp)
+    {
+        const unsigned char *p = (const unsigned char *) src;
+        const int            c = d  / 8;
+        const int            o = od / 8;
+        const int            b = 64;
+
+        // Outer and center weights, normalized so a unit slope per pixel
+        // gives a unit gradient.
+
+        const float wo = (kernel == normal_scharr) ?  3.f / 32 : 1.f / 8;
+        const float wc = (kernel == normal_scharr) ? 10.f / 32 : 2.f / 8;
+        const float k  = -strength / 255.f;
+
+        auto index = [&](int i, int n)
+        {
+            if (wrap == wrap_repeat) return (i + n) % n;
+            return std::min(std::max(i, 0), n - 1);
+        };
+
+        parallel_for((h + b - 1) / b, [&](int t)
+        {
+            const int y0 = t * b;
+            const int y1 = std::min(y0 + b, h);
+
+            // Convert the band and the rows above and below it to floats.
+
+            std::vector<float> z(size_t(w) * (y1 - y0 + 2));
+
+            for (int y = y0 - 1; y <= y1; y++)
+            {
+                const unsigned char *r = p + size_t(index(y, h)) * w * c;
+                float               *s = &z[0] + size_t(y - y0 + 1) * w;
+
+                for (int x = 0; x < w; x++)
+                    s[x] = float(luma(r, x, c));
+            }
+
+            for (int y = y0; y < y1; y++)
+            {
+                const float *lo = &z[0] + size_t(y - y0)     * w;
+                const float *md = &z[0] + size_t(y - y0 + 1) * w;
+                const float *hi = &z[0] + size_t(y - y0 + 2) * w;
+
+                unsigned char *q = (unsigned char *) dst + size_t(y) * w * o;
+
+                auto store = [&](int x, float nx, float ny, float nz)
+                {
+                    unsigned char *v = q + x * o;
+
+                    if (o == 2)
+                    {
+                        v[0] = quantize(0.5f + 0.5f * nx, false);
+                        v[1] = quantize(0.5f + 0.5f * ny, false);
+                    }
+                    else
+                    {
+                        v[0] = quantize(0.5f + 0.5f * nz, false);
+                        v[1] = quantize(0.5f + 0.5f * ny, false);
+                        v[2] = quantize(0.5f + 0.5f * nx, false);
+                    }
+                };
+
+                auto sample = [&](int x)
+                {
+                    const int l = index(x - 1, w);
+                    const int r = index(x + 1, w);
+
+                    const float gx = wo * (lo[r] + hi[r] - lo[l] - hi[l])
+                                   + wc * (md[r] - md[l]);
+                    const float gy = wo * (hi[l] + hi[r] - lo[l] - lo[r])
+                                   + wc * (hi[x] - lo[x]);
+
+                    const float nx = gx * k;
+                    const float ny = gy * k;
+                    const float nz = 1.f / std::sqrt(1.f + nx * nx + ny * ny);
+
+                    store(x, nx * nz, ny * nz, nz);
+                };
+
+                int x = 1;
+
+                sample(0);
+#ifdef __SSE2__
+                const __m128 Wo = _mm_set1_ps(wo);
+                const __m128 Wc = _mm_set1_ps(wc);
+                const __m128 K  = _mm_set1_ps(k);
+                const __m128 one = _mm_set1_ps(1.f);
+
+                for (; x + 4 < w; x += 4)
+                {
+                    const __m128 ll = _mm_loadu_ps(lo + x - 1);
+                    const __m128 lm = _mm_loadu_ps(lo + x);
+                    const __m128 lr = _mm_loadu_ps(lo + x + 1);
+                    const __m128 ml = _mm_loadu_ps(md + x - 1);
+                    const __m128 mr = _mm_loadu_ps(md + x + 1);
+                    const __m128 hl = _mm_loadu_ps(hi + x - 1);
+                    const __m128 hm = _mm_loadu_ps(hi + x);
+                    const __m128 hr = _mm_loadu_ps(hi + x + 1);
+
+                    const __m128 gx = _mm_add_ps(
+                        _mm_mul_ps(Wo, _mm_sub_ps(_mm_add_ps(lr, hr),
+                                                  _mm_add_ps(ll, hl))),
+                        _mm_mul_ps(Wc, _mm_sub_ps(mr, ml)));
+                    const __m128 gy = _mm_add_ps(
+                        _mm_mul_ps(Wo, _mm_sub_ps(_mm_add_ps(hl, hr),
+                                                  _mm_add_ps(ll, lr))),
+                        _mm_mul_ps(Wc, _mm_sub_ps(hm, lm)));
+
+                    const __m128 nx = _mm_mul_ps(gx, K);
+                    const __m128 ny = _mm_mul_ps(gy, K);
+                    const __m128 nz = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(one,
+                                      _mm_add_ps(_mm_mul_ps(nx, nx),
+                                                 _mm_mul_ps(ny, ny)))));
+                    float X[4], Y[4], Z[4];
+
+                    _mm_storeu_ps(X, _mm_mul_ps(nx, nz));
+                    _mm_storeu_ps(Y, _mm_mul_ps(ny, nz));
+                    _mm_storeu_ps(Z, nz);
+
+                    for (int e = 0; e < 4; e++)
+                        store(x + e, X[e], Y[e], Z[e]);
+                }
+#endif
+                for (; x < w; x++)
+                    sample(x);
+            }
+        });
+    }
+
+    //--------------------------------------------------------------------------
+
+    /// Compute the exact squared Euclidean distance transform of the n values
+    /// of f in place, following Felzenszwalb and Huttenlocher. Features hold
+    /// zero and all other values are large. Scratch v, z, and d must hold n,
+    /// n + 1, and n values.
+
+    inline void distance_1d(float *f, int n, int *v, double *z, float *d)
+    {
+        int k = 0;
+
+        v[0] = 0;
+        z[0] = -1e30;
+        z[1] = +1e30;
+
+        auto meet = [&](int q, int r)
+        {
+            return ((double(f[q]) + double(q) * q) - (double(f[r]) + double(r) * r))
+                 / (2.0 * (q - r));
+        };
+
+        for (int q = 1; q < n; q++)
+        {
+            double t = meet(q, v[k]);
+
+            while (t <= z[k])
+                t = meet(q, v[--k]);
+
+            k++;
+            v[k]     = q;
+            z[k]     = t;
+            z[k + 1] = +1e30;
+        }
+
+        k = 0;
+
+        for (int q = 0; q < n; q++)
+        {
+            while (z[k + 1] < q)
+                k++;
+
+            const float e = float(q - v[k]);
+
+            d[q] = e * e + f[v[k]];
+        }
+        memcpy(f, d, sizeof (float) * n);
+    }
+
+    /// Compute the 2D squared distance transform of the w by h field f in
+    /// place, with rows and then columns spread over all cores.
+
+    inline void distance_2d(float *f, int w, int h)
+    {
+        parallel_for(h, [&](int y)
+        {
+            std::vector<int>    v(w);
+            std::vector<double> z(w + 1);
+            std::vector<float>  d(w);
+
+            distance_1d(f + size_t(y) * w, w, &v[0], &z[0], &d[0]);
+        });
+
+        parallel_for(w, [&](int x)
+        {
+            std::vector<int>    v(h);
+            std::vector<double> z(h + 1);
+            std::vector<float>  d(h);
+            std::vector<float>  c(h);
+
+            for (int y = 0; y < h; y++) c[y] = f[size_t(y) * w + x];
+
+            distance_1d(&c[0], h, &v[0], &z[0], &d[0]);
+
+            for (int y = 0; y < h; y++) f[size_t(y) * w + x] = c[y];
+        });
+    }
+
+    /// Compute a signed distance field of the w by h mask image src of depth
+    /// d and store it in the 8-bit dw by dh buffer dst. The mask is the alpha
+    /// channel of two- and four-channel images and the first channel of all
+    /// others. Pixels at or above threshold t are inside. Distances are exact
+    /// in source pixels, positive inside, and box-filtered down to the output
+    /// size. A value of 128 marks the edge, and 0 and 255 lie spread source
+    /// pixels outside and inside it.
+
+    inline void make_sdf(const void *src, int w, int h, int d,
+                               void *dst, int dw, int dh,
+                         float spread, int t = 128)
+    {
+        const unsigned char *p = (const unsigned char *) src;
+        const size_t         n = size_t(w) * h;
+        const int            c = d / 8;
+        const int            a = (c == 2 || c == 4) ? c - 1 : 0;
+
+        std::vector<float> inner(n);
+        std::vector<float> outer(n);
+
+        parallel_bands(n, [&](size_t i0, size_t i1)
+        {
+            for (size_t i = i0; i < i1; i++)
+            {
+                const bool in = (p[i * c + a] >= t);
+
+                inner[i] = in ? 1e20f : 0.f;
+                outer[i] = in ? 0.f : 1e20f;
+            }
+        });
+
+        distance_2d(&inner[0], w, h);
+        distance_2d(&outer[0], w, h);
+
+        parallel_bands(n, [&](size_t i0, size_t i1)
+        {
+            for (size_t i = i0; i < i1; i++)
+                inner[i] = (inner[i] > 0) ? std::sqrt(inner[i]) - 0.5f
+                                          : 0.5f - std::sqrt(outer[i]);
+        });
+
+        if (dw != w || dh != h)
+        {
+            outer.resize(size_t(dw) * dh);
+            resample(&inner[0], w, h, &outer[0], dw, dh, 1, filter_box);
+            inner.swap(outer);
+        }
+
+        unsigned char *q = (unsigned char *) dst;
+
+        parallel_bands(size_t(dw) * dh, [&](size_t i0, size_t i1)
+        {
+            for (size_t i = i0; i < i1; i++)
+            {
+                const float v = 0.5f + inner[i] / (2 * spread);
+                q[i] = (unsigned char) (255.f * std::min(std::max(v, 0.f), 1.f)
+                                              + 0.5f);
+            }
+        });
+    }
+
+    /// Read the named Targa mask image, compute its signed distance field
+    /// reduced by the given factor, and write it as an 8-bit grayscale Targa.
+    /// Return 0 on success and -1 on failure.
+
+    inline int make_sdf_tga(const char *src, const char *dst,
+                            int factor, float spread, int t = 128)
+    {
+        int   err = -1, w, h, d;
+        void *p   = read_tga(src, w, h, d);
+
+        if (p)
+        {
+            const int dw = std::max(w / factor, 1);
+            const int dh = std::max(h / factor, 1);
+
+            if (void *q = malloc(size_t(dw) * dh))
+            {
+                make_sdf(p, w, h, d, q, dw, dh, spread, t);
+                err = write_tga(dst, dw, dh, 8, q);
+                free(q);
+            }
+            free(p);
+        }
+        return err;
+    }
+
+    //--------------------------------------------------------------------------
+}
+
+#endif
@@ -0,0 +1,2544 @@
+// Copyright (c) 2014 Robert Kooima
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef GLSHADER_HPP
+#define GLSHADER_HPP
+
+/// This header extends the shader functions of GLFundamentals.hpp with the
+/// machinery needed by applications with many programs: caching of linked
+/// program binaries across runs, batch compilation, #include handling, and
+/// reloading of programs as their sources are edited, program reflection,
+/// uniform block packing and streaming, shader variants, the sharing of shader
+/// objects among programs, separable programs, and shader embedding.
+
+//------------------------------------------------------------------------------
+
+#include "GLFundamentals.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <map>
+#include <set>
+
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#  include <process.h>
+#else
+#  include <unistd.h>
+#endif
+
+#ifdef __linux__
+#  include <sys/inotify.h>
+#endif
+
+#ifndef  GL_COMPLETION_STATUS_KHR
+#define  GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+//------------------------------------------------------------------------------
+
+namespace gl
+{
+    /// Return true if the current context supports the named extension.
+
+    inline bool has_extension(const char *name)
+    {
+        GLint n = 0;
+
+        glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+
+        for (GLint i = 0; i < n; i++)
+            if (strcmp((const char *) glGetStringi(GL_EXTENSIONS, i), name) == 0)
+                return true;
+
+        return false;
+    }
+
+    /// Return source with the given lines of definitions inserted after its
+    /// #version directive, or at the top if it has none.
+
+    inline std::string insert_defines(const std::string& source,
+                                      const std::string& defines)
+    {
+        if (defines.empty())
+            return source;
+
+        size_t i = source.find("#version");
+
+        if (i == std::string::npos)
+            i = 0;
+        else if ((i = source.find('\n', i)) == std::string::npos)
+            i = source.size();
+        else
+            i++;
+
+        std::string s = source.substr(0, i);
+
+        s += defines;
+
+        if (s[s.size() - 1] != '\n')
+            s += '\n';
+
+        return s + source.substr(i);
+    }
+
+    /// Compile the n shaders of the given types and sources, with defines
+    /// inserted, and link them. If retrievable is true, ask the driver to
+    /// keep the program binary. Return 0 on failure.
+
+    inline GLuint link_program(int n, const GLenum *types,
+                               const char *const *sources,
+                               const char *defines = 0,
+                               bool retrievable = false)
+    {
+        std::vector<GLuint> shaders;
+
+        for (int i = 0; i < n; i++)
+        {
+            std::string s = insert_defines(sources[i], defines ? defines : "");
+
+            if (GLuint shader = init_shader(types[i], s.c_str()))
+                shaders.push_back(shader);
+        }
+
+        GLuint program = 0;
+
+        if (int(shaders.size()) == n && (program = glCreateProgram()))
+        {
+            for (int i = 0; i < n; i++)
+                glAttachShader(program, shaders[i]);
+
+            if (retrievable)
+                glProgramParameteri(program,
+                                    GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+            glLinkProgram(program);
+
+            for (int i = 0; i < n; i++)
+                glDetachShader(program, shaders[i]);
+
+            if (!report_program_status(program))
+            {
+                glDeleteProgram(program);
+                program = 0;
+            }
+        }
+
+        for (size_t i = 0; i < shaders.size(); i++)
+            glDeleteShader(shaders[i]);
+
+        return program;
+    }
+
+    //--------------------------------------------------------------------------
+
+    /// The header of a cached program binary file.
+
+    struct program_binary_head
+    {
+        char               magic[4];
+        unsigned int       version;
+        unsigned long long key;
+        unsigned long long check;
+        unsigned int       format;
+        unsigned int       length;
+    };
+
+    /// A cache of linked program binaries in a directory on disk. Each entry
+    /// is keyed by a hash of its shader types and sources, its definitions,
+    /// and the vendor, renderer, and version strings of the driver, so that
+    /// a driver update invalidates it. Entries are written to a temporary
+    /// file and renamed into place, so concurrent or interrupted runs never
+    /// leave a partial entry. A binary rejected by the driver is silently
+    /// replaced by compiling from source. All calls require the context.
+
+    class program_cache
+    {
+    public:
+
+        /// Create a cache in the named directory, which must exist.
+
+        program_cache(const char *dir) :
+            path(dir), hits(0), misses(0), rejects(0), supported(-1)
+        {
+        }
+
+        /// Return a program with the n shaders of the given types and
+        /// sources, with defines inserted after each #version. Load it from
+        /// the cache if possible, or compile, link, and store it. Return 0
+        /// on failure.
+
+        GLuint init_program(int n, const GLenum *types,
+                            const char *const *sources, const char *defines = 0)
+        {
+            if (!available())
+                return link_program(n, types, sources, defines);
+
+            const unsigned long long k = key(n, types, sources, defines);
+            const std::string        f = filename(k);
+
+            if (GLuint program = load(f, k))
+            {
+                hits++;
+                return program;
+            }
+
+            misses++;
+
+            GLuint program = link_program(n, types, sources, defines, true);
+
+            if (program)
+                store(f, k, program);
+
+            return program;
+        }
+
+        /// Return a program using the named vertex and fragment shader source
+        /// files, as does the init_program function.
+
+        GLuint init_program(const char *vert_filename,
+                            const char *frag_filename, const char *defines = 0)
+        {
+            GLuint program = 0;
+
+            char *vert_source = read_shader_source(vert_filename);
+            char *frag_source = read_shader_source(frag_filename);
+
+            if (vert_source && frag_source)
+            {
+                const GLenum      t[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+                const char *const s[2] = { vert_source,      frag_source        };
+
+                program = init_program(2, t, s, defines);
+            }
+
+            free(frag_source);
+            free(vert_source);
+
+            return program;
+        }
+
+        /// Print the hit rate to the given stream.
+
+        void report(FILE *stream = stderr) const
+        {
+            const int n = hits + misses;
+
+            fprintf(stream, "Program cache: %d of %d hit (%.1f%%), %d rejected\n",
+                    hits, n, n ? 100.0 * hits / n : 0.0, rejects);
+        }
+
+        int get_hits()    const { return hits;    }
+        int get_misses()  const { return misses;  }
+        int get_rejects() const { return rejects; }
+
+    private:
+
+        /// Return true if the driver can return program binaries.
+
+        bool available()
+        {
+            if (supported < 0)
+            {
+                GLint n = 0;
+#ifdef GLEW_VERSION
+                if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)
+#endif
+                glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &n);
+
+                supported = (n > 0) ? 1 : 0;
+
+                if (supported)
+                {
+                    driver  = (const char *) glGetString(GL_VENDOR);
+                    driver += '\n';
+                    driver += (const char *) glGetString(GL_RENDERER);
+                    driver += '\n';
+                    driver += (const char *) glGetString(GL_VERSION);
+                }
+            }
+            return supported != 0;
+        }
+
+        unsigned long long key(int n, const GLenum *types,
+                               const char *const *sources,
+                               const char *defines) const
+        {
+            unsigned long long h = hash(driver.c_str(), driver.size() + 1);
+
+            for (int i = 0; i < n; i++)
+            {
+                h = hash(types + i, sizeof (GLenum), h);
+                h = hash(sources[i], strlen(sources[i]) + 1, h);
+            }
+            if (defines)
+                h = hash(defines, strlen(defines), h);
+
+            return h;
+        }
+
+        std::string filename(unsigned long long k) const
+        {
+            char s[32];
+            sprintf(s, "/%016llx.bin", k);
+            return path + s;
+        }
+
+        /// Create a program from the named cache entry. Return 0 if it is
+        /// absent, damaged, or refused by the driver.
+
+        GLuint load(const std::string& f, unsigned long long k)
+        {
+            GLuint program = 0;
+
+            if (FILE *stream = fopen(f.c_str(), "rb"))
+            {
+                program_binary_head head;
+                std::vector<char>   data;
+
+                // Bound the payload by the file size before allocating it.
+
+                long z = -1;
+
+                if (fseek(stream, 0, SEEK_END) == 0)
+                    z = ftell(stream);
+
+                if (z >= long(sizeof (head)) && fseek(stream, 0, SEEK_SET) == 0
+                    && fread(&head, sizeof (head), 1, stream) == 1
+                    && memcmp(head.magic, "GLPB", 4) == 0
+                    && head.version == 1 && head.key == k && head.length > 0
+                    && head.length == (unsigned long) z - sizeof (head))
+                {
+                    data.resize(head.length);
+
+                    if (fread(&data[0], 1, data.size(), stream) != data.size()
+                        || hash(&data[0], data.size()) != head.check)
+                        data.clear();
+                }
+                fclose(stream);
+
+                if (!data.empty() && (program = glCreateProgram()))
+                {
+                    GLint s = 0;
+
+                    glProgramBinary(program, head.format,
+                                    &data[0], GLsizei(data.size()));
+                    glGetProgramiv(program, GL_LINK_STATUS, &s);
+
+                    if (s == 0)
+                    {
+                        // Discard the errors of the refused binary, so the
+                        // caller's compile and link report only its own.
+
+                        while (glGetError() != GL_NO_ERROR)
+                            ;
+
+                        glDeleteProgram(program);
+                        program = 0;
+                    }
+                }
+                if (program == 0)
+                    rejects++;
+            }
+            return program;
+        }
+
+        /// Store the binary of the given program as the named cache entry.
+
+        void store(const std::string& f, unsigned long long k, GLuint program)
+        {
+            GLint  n = 0;
+            GLenum format;
+
+            glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &n);
+
+            if (n > 0)
+            {
+                std::vector<char> data(n);
+
+                glGetProgramBinary(program, n, &n, &format, &data[0]);
+
+                if (n > 0)
+                {
+                    program_binary_head head;
+
+                    memcpy(head.magic, "GLPB", 4);
+                    head.version = 1;
+                    head.key     = k;
+                    head.check   = hash(&data[0], size_t(n));
+                    head.format  = format;
+                    head.length  = (unsigned int) n;
+
+#ifdef _WIN32
+                    const int pid = _getpid();
+#else
+                    const int pid = getpid();
+#endif
+                    std::string t = f + "." + std::to_string(pid) + ".tmp";
+
+                    if (FILE *stream = fopen(t.c_str(), "wb"))
+                    {
+                        bool ok = fwrite(&head, sizeof (head), 1, stream) == 1
+                               && fwrite(&data[0], 1, n, stream) == size_t(n);
+
+                        ok = (fclose(stream) == 0) && ok;
+#ifdef _WIN32
+                        if (ok) remove(f.c_str());
+#endif
+                        if (!ok || rename(t.c_str(), f.c_str()))
+                            remove(t.c_str());
+                    }
+                }
+            }
+        }
+
+        std::string path;
+        std::string driver;
+
+        int hits;
+        int misses;
+        int rejects;
+        int supported;
+    };
+
+    //--------------------------------------------------------------------------
+
+    /// A shader source reader resolving #include directives. Quoted names are
+    /// found relative to the including file and then along the search paths,
+    /// bracketed names along the search paths only. Each file is included at
+    /// most once per shader, so no include guards are needed, and cycles are
+    /// harmless. A #version in an included file is commented out.
+    ///
+    /// Every file is given a number, and #line directives using it are
+    /// emitted around each include, so compiler messages of the form n:l give
+    /// line l of file_name(n). Files are parsed once and re-read only when
+    /// modified. The files read by each shader are recorded, so that a change
+    /// to one shared include identifies exactly the shaders to rebuild.
+
+    class shader_includes
+    {
+    public:
+
+        /// Add a directory to search for included files.
+
+        void add_path(const char *dir)
+        {
+            paths.push_back(dir);
+        }
+
+        /// Return the named shader source with all includes resolved, or an
+        /// empty string on failure.
+
+        std::string read(const char *filename)
+        {
+            const std::string root = normalize_path(filename);
+
+            std::set<std::string> seen;
+            std::string           out;
+
+            int offset = 0;
+
+            if (const file *f = load(root))
+                if (f->version >= 0)
+                {
+                    const std::string& v = f->chunks[f->version].text;
+                    const int          n = atoi(v.c_str() + v.find("version") + 7);
+
+                    if (n < 330 && v.find("es") == std::string::npos)
+                        offset = 1;
+                }
+
+            if (expand(root, root, out, seen, offset))
+            {
+                graph[root] = seen;
+                return out;
+            }
+            return std::string();
+        }
+
+        /// Return the name of file number n, as given in #line directives.
+
+        const char *file_name(int n) const
+        {
+            return (n >= 0 && n < int(names.size())) ? names[n].c_str() : "";
+        }
+
+        /// Return all files read by the named shader when last read.
+
+        std::vector<std::string> dependencies(const char *filename) const
+        {
+            std::vector<std::string> v;
+
+            auto i = graph.find(normalize_path(filename));
+
+            if (i != graph.end())
+                v.assign(i->second.begin(), i->second.end());
+
+            return v;
+        }
+
+        /// Return the name under which the named file is embedded: its path
+        /// relative to the search path on which it was found, if any, and
+        /// otherwise its normalized path.
+
+        std::string embedded_name(const char *filename) const
+        {
+            return key(normalize_path(filename));
+        }
+
+        /// Return all shaders that read the named file when last read.
+
+        std::vector<std::string> dependents(const char *filename) const
+        {
+            const std::string f = normalize_path(filename);
+
+            std::vector<std::string> v;
+
+            for (auto i = graph.begin(); i != graph.end(); ++i)
+                if (i->second.count(f))
+                    v.push_back(i->first);
+
+            return v;
+        }
+
+        /// Discard the parsed text of the named file, or of all files.
+
+        void invalidate(const char *filename = 0)
+        {
+            if (filename)
+                files.erase(normalize_path(filename));
+            else
+                files.clear();
+        }
+
+    private:
+
+        /// A run of lines starting at line, or an #include or #version line.
+
+        struct chunk
+        {
+            enum { lines, quoted, bracketed, version } kind;
+
+            std::string text;
+            int         line;
+        };
+
+        struct file
+        {
+            time_t             mtime;
+            off_t              size;
+            int                number;
+            int                version;
+            std::vector<chunk> chunks;
+        };
+
+        /// Return the parsed named file, reading it if new or modified.
+
+        const file *load(const std::string& name)
+        {
+            const char *s;
+            time_t      t;
+            off_t       z;
+
+            if (!status(name, key(name), t, z, s))
+                return 0;
+
+            auto i = files.find(name);
+
+            if (i != files.end() && i->second.mtime == t
+                                 && i->second.size  == z)
+                return &i->second;
+
+            char *p = s ? 0 : read_shader_source(name.c_str());
+
+            if (s == 0 && p == 0)
+                return 0;
+
+            file f;
+
+            f.mtime   = t;
+            f.size    = z;
+            f.number  = number(name);
+            f.version = -1;
+
+            const char *c = s ? s : p;
+
+            for (int line = 1; *c; line++)
+            {
+                const char *e = strchr(c, '\n');
+                const char *n = e ? e + 1 : c + strlen(c);
+                const char *d = c + strspn(c, " \t");
+
+                chunk k;
+
+                k.kind = chunk::lines;
+                k.line = line;
+                k.text.assign(c, n);
+
+                if (*d == '#')
+                {
+                    d += 1 + strspn(d + 1, " \t");
+
+                    if (strncmp(d, "include", 7) == 0)
+                    {
+                        const char *a = d + 7 + strspn(d + 7, " \t");
+                        const char *b = 0;
+
+                        if      (*a == '"') b = strchr(a + 1, '"');
+                        else if (*a == '<') b = strchr(a + 1, '>');
+
+                        if (b && (!e || b < e))
+                        {
+                            k.kind = (*a == '"') ? chunk::quoted : chunk::bracketed;
+                            k.text.assign(a + 1, b);
+                        }
+                    }
+                    else if (strncmp(d, "version", 7) == 0)
+                    {
+                        k.kind    = chunk::version;
+                        f.version = int(f.chunks.size());
+                    }
+                }
+
+                if (k.kind == chunk::lines && !f.chunks.empty()
+                                          && f.chunks.back().kind == chunk::lines)
+                    f.chunks.back().text += k.text;
+                else
+                    f.chunks.push_back(k);
+
+                c = n;
+            }
+            free(p);
+
+            return &(files[name] = f);
+        }
+
+        /// Find the modification time and size of the named file, or zeros if
+        /// it is served from the shader embedded under the given key, in which
+        /// case give that source in e. Return false if neither.
+
+        static bool status(const std::string& name, const std::string& key,
+                           time_t& t, off_t& z, const char *& e)
+        {
+            const char *s = get_embedded_shader(key.c_str());
+
+            struct stat st;
+
+            if ((!s || embedded_state::get().disk) && stat(name.c_str(), &st) == 0)
+            {
+                t = st.st_mtime;
+                z = st.st_size;
+                e = 0;
+                return true;
+            }
+            t = 0;
+            z = 0;
+            e = s;
+            return s != 0;
+        }
+
+        /// Return the embedded name of the named file.
+
+        std::string key(const std::string& name) const
+        {
+            auto i = keys.find(name);
+            return (i == keys.end()) ? name : i->second;
+        }
+
+        /// Return the number of the named file, assigning one if new.
+
+        int number(const std::string& name)
+        {
+            for (size_t i = 0; i < names.size(); i++)
+                if (names[i] == name)
+                    return int(i);
+
+            names.push_back(name);
+            return int(names.size()) - 1;
+        }
+
+        /// Return the path of an included file, or an empty string. A file
+        /// found on a search path is embedded under its path relative to that
+        /// one, and so are the files it includes relative to itself.
+
+        std::string resolve(const std::string& from, const chunk& k)
+        {
+            const char *e;
+            time_t      t;
+            off_t       z;
+
+            if (k.kind == chunk::quoted)
+            {
+                const std::string f = key(from);
+                const size_t      i = from.rfind('/');
+                const size_t      j = f.rfind('/');
+                const std::string s = normalize_path((i == std::string::npos)
+                                    ? k.text : from.substr(0, i + 1) + k.text);
+                const std::string r = normalize_path((j == std::string::npos)
+                                    ? k.text : f.substr(0, j + 1) + k.text);
+
+                if (status(s, r, t, z, e))
+                {
+                    if (r != s) keys[s] = r;
+                    return s;
+                }
+            }
+            for (size_t i = 0; i < paths.size(); i++)
+            {
+                const std::string s = normalize_path(paths[i] + "/" + k.text);
+                const std::string r = normalize_path(k.text);
+
+                if (status(s, r, t, z, e))
+                {
+                    if (r != s) keys[s] = r;
+                    return s;
+                }
+            }
+            return std::string();
+        }
+
+        /// Append the named file to out, with includes expanded.
+
+        bool expand(const std::string& name, const std::string& root,
+                    std::string& out, std::set<std::string>& seen, int offset)
+        {
+            seen.insert(name);
+
+            const file *f = load(name);
+
+            if (f == 0)
+            {
+                fprintf(stderr, "Failed to open '%s'.\n", name.c_str());
+                return false;
+            }
+
+            const std::vector<chunk>& chunks = f->chunks;
+
+            const int number  = f->number;
+            const int version = (name == root) ? f->version : -1;
+
+            for (size_t i = 0; i < chunks.size(); i++)
+            {
+                const chunk& k = chunks[i];
+
+                switch (k.kind)
+                {
+                case chunk::version:
+
+                    out += (name == root) ? "" : "// ";
+                    out += k.text;
+                    break;
+
+                case chunk::lines:
+
+                    if (!out.empty() && out[out.size() - 1] != '\n')
+                        out += '\n';
+                    if (int(i) > version)
+                        out += "#line " + std::to_string(k.line - offset) + " "
+                                        + std::to_string(number) + "\n";
+                    out += k.text;
+                    break;
+
+                default:
+                {
+                    const std::string s = resolve(name, k);
+
+                    if (s.empty())
+                    {
+                        fprintf(stderr, "%s:%d: Failed to include '%s'.\n",
+                                name.c_str(), k.line, k.text.c_str());
+                        return false;
+                    }
+                    if (seen.count(s) == 0 && !expand(s, root, out, seen, offset))
+                        return false;
+                }
+                }
+            }
+            return true;
+        }
+
+        std::vector<std::string> paths;
+        std::vector<std::string> names;
+
+        std::map<std::string, file>                  files;
+        std::map<std::string, std::string>           keys;
+        std::map<std::string, std::set<std::string> > graph;
+    };
+
+    //--------------------------------------------------------------------------
+
+    /// A set of programs rebuilt whenever their sources change. Sources are
+    /// read through a shader_includes, so an edit to a shared include
+    /// rebuilds exactly the programs using it. Changes are found with inotify
+    /// on Linux, and by checking modification times elsewhere. Poll between
+    /// frames on the GL thread. A program is replaced only once its rebuild
+    /// compiles and links, so a broken edit leaves the last good one in use
+    /// and its log available.
+
+    class shader_watcher
+    {
+    public:
+
+        shader_watcher() : fd(-1)
+        {
+#ifdef __linux__
+            fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+        }
+
+       ~shader_watcher()
+        {
+#ifdef __linux__
+            if (fd >= 0) close(fd);
+#endif
+        }
+
+        /// Build and watch a program using the named vertex and fragment
+        /// shader source files, with defines inserted. Return its index.
+
+        int add(const char *vert_filename, const char *frag_filename,
+                const char *defines = 0)
+        {
+            entry e;
+
+            e.vert    = normalize_path(vert_filename);
+            e.frag    = normalize_path(frag_filename);
+            e.defines = defines ? defines : "";
+            e.program = 0;
+
+            build(e);
+            entries.push_back(e);
+
+            return int(entries.size()) - 1;
+        }
+
+        /// Rebuild the programs affected by any changed sources. Return true
+        /// if any program was replaced, invalidating its uniform locations.
+
+        bool poll()
+        {
+            std::set<std::string> changed;
+#ifdef __linux__
+            char b[4096];
+            ssize_t n;
+
+            while (fd >= 0 && (n = read(fd, b, sizeof (b))) > 0)
+                for (char *p = b; p < b + n; )
+                {
+                    struct inotify_event e;
+
+                    memcpy(&e, p, sizeof (e));
+
+                    if (e.len && dirs.count(e.wd))
+                        changed.insert(normalize_path(dirs[e.wd] + "/"
+                                                      + (p + sizeof (e))));
+
+                    p += sizeof (e) + e.len;
+                }
+#else
+            for (auto i = times.begin(); i != times.end(); ++i)
+            {
+                struct stat st;
+
+                if (stat(i->first.c_str(), &st) == 0 && st.st_mtime != i->second)
+                {
+                    i->second = st.st_mtime;
+                    changed.insert(i->first);
+                }
+            }
+#endif
+            std::set<std::string> roots;
+
+            for (auto i = changed.begin(); i != changed.end(); ++i)
+            {
+                std::vector<std::string> v = includes.dependents(i->c_str());
+
+                includes.invalidate(i->c_str());
+                roots.insert(*i);
+                roots.insert(v.begin(), v.end());
+            }
+
+            bool swapped = false;
+
+            for (size_t i = 0; i < entries.size(); i++)
+                if (roots.count(entries[i].vert) || roots.count(entries[i].frag))
+                    swapped = build(entries[i]) || swapped;
+
+            return swapped;
+        }
+
+        /// Return program i, the last of its builds to succeed, or 0.
+
+        GLuint get(int i) const
+        {
+            return entries[i].program;
+        }
+
+        /// Return the log of the last build of program i, empty if it
+        /// succeeded.
+
+        const std::string& get_log(int i) const
+        {
+            return entries[i].log;
+        }
+
+        /// Return the include resolver, e.g. to add search paths.
+
+        shader_includes& get_includes()
+        {
+            return includes;
+        }
+
+        /// Delete all programs and stop watching. Requires the context.
+
+        void clear()
+        {
+            for (size_t i = 0; i < entries.size(); i++)
+                glDeleteProgram(entries[i].program);
+
+            entries.clear();
+        }
+
+    private:
+
+        struct entry
+        {
+            std::string vert;
+            std::string frag;
+            std::string defines;
+            std::string log;
+            GLuint      program;
+        };
+
+        /// Compile and link e, replacing its program on success and keeping
+        /// the log on failure. Return true on success.
+
+        bool build(entry& e)
+        {
+            const std::string v = includes.read(e.vert.c_str());
+            const std::string f = includes.read(e.frag.c_str());
+
+            watch(e.vert);
+            watch(e.frag);
+
+            if (v.empty() || f.empty())
+            {
+                e.log = "Failed to read '" + (v.empty() ? e.vert : e.frag) + "'.\n";
+                return false;
+            }
+
+            FILE *stream = tmpfile();
+            FILE *report = stream ? stream : stderr;
+
+            GLuint vs = compile(GL_VERTEX_SHADER,   insert_defines(v, e.defines), report);
+            GLuint fs = compile(GL_FRAGMENT_SHADER, insert_defines(f, e.defines), report);
+            GLuint program = 0;
+
+            if (vs && fs && (program = glCreateProgram()))
+            {
+                glAttachShader(program, vs);
+                glAttachShader(program, fs);
+                glLinkProgram (program);
+                glDetachShader(program, fs);
+                glDetachShader(program, vs);
+
+                if (!report_program_status(program, report))
+                {
+                    glDeleteProgram(program);
+                    program = 0;
+                }
+            }
+            glDeleteShader(fs);
+            glDeleteShader(vs);
+
+            e.log.clear();
+
+            if (stream)
+            {
+                e.log.resize(size_t(ftell(stream)));
+                rewind(stream);
+
+                if (!e.log.empty() && fread(&e.log[0], 1, e.log.size(), stream) == 0)
+                    e.log.clear();
+
+                fclose(stream);
+                fputs(e.log.c_str(), stderr);
+            }
+
+            if (program)
+            {
+                glDeleteProgram(e.program);
+                e.program = program;
+            }
+            return program != 0;
+        }
+
+        static GLuint compile(GLenum type, const std::string& source, FILE *stream)
+        {
+            const GLchar *s = source.c_str();
+            GLuint   shader = glCreateShader(type);
+
+            glShaderSource (shader, 1, &s, NULL);
+            glCompileShader(shader);
+
+            if (report_shader_status(shader, stream))
+                return shader;
+
+            glDeleteShader(shader);
+            return 0;
+        }
+
+        /// Watch every file read by the named shader.
+
+        void watch(const std::string& name)
+        {
+            std::vector<std::string> v = includes.dependencies(name.c_str());
+
+            v.push_back(name);
+
+            for (size_t i = 0; i < v.size(); i++)
+            {
+#ifdef __linux__
+                const size_t      k = v[i].rfind('/');
+                const std::string d = (k == std::string::npos) ? "." : v[i].substr(0, k);
+
+                bool found = false;
+
+                for (auto j = dirs.begin(); j != dirs.end(); ++j)
+                    found = found || (j->second == d);
+
+                if (!found && fd >= 0)
+                {
+                    int wd = inotify_add_watch(fd, d.empty() ? "/" : d.c_str(),
+                                               IN_CLOSE_WRITE | IN_MOVED_TO);
+                    if (wd >= 0)
+                        dirs[wd] = d;
+                }
+#else
+                struct stat st;
+
+                if (times.count(v[i]) == 0)
+                    times[v[i]] = (stat(v[i].c_str(), &st) == 0) ? st.st_mtime : 0;
+#endif
+            }
+        }
+
+        shader_includes    includes;
+        std::vector<entry> entries;
+
+        int fd;
+
+        std::map<int, std::string>    dirs;
+        std::map<std::string, time_t> times;
+    };
+
+    //--------------------------------------------------------------------------
+
+    /// A batch of programs compiled together so that the driver may work on
+    /// all of them at once. Add programs, start the batch, and either poll
+    /// it between frames or wait for it. Startup then costs roughly as much
+    /// as the slowest program rather than the sum of all of them.
+    ///
+    /// With GL_KHR_parallel_shader_compile, every compile and link is issued
+    /// up front and completion is polled without blocking. Otherwise, if a
+    /// share function is given, the batch is compiled on a worker thread,
+    /// which calls share(true) to make current a context sharing objects with
+    /// the caller's, and share(false) when done. Failing both, all compiles
+    /// and links are still issued before any status is queried.
+
+    class program_batch
+    {
+    public:
+
+        program_batch() : mode(idle), done(false)
+        {
+        }
+
+       ~program_batch()
+        {
+            if (worker.joinable())
+                worker.join();
+        }
+
+        /// Add a program with the n shaders of the given types and sources,
+        /// with defines inserted after each #version. Return its index.
+
+        int add(int n, const GLenum *types, const char *const *sources,
+                const char *defines = 0)
+        {
+            entry e;
+
+            for (int i = 0; i < n; i++)
+            {
+                e.types.push_back(types[i]);
+                e.sources.push_back(insert_defines(sources[i],
+                                                   defines ? defines : ""));
+            }
+            e.program = 0;
+            entries.push_back(e);
+
+            return int(entries.size()) - 1;
+        }
+
+        /// Add a program using the named vertex and fragment shader source
+        /// files. Return its index, or -1 if either cannot be read.
+
+        int add(const char *vert_filename, const char *frag_filename,
+                const char *defines = 0)
+        {
+            int i = -1;
+
+            char *vert_source = read_shader_source(vert_filename);
+            char *frag_source = read_shader_source(frag_filename);
+
+            if (vert_source && frag_source)
+            {
+                const GLenum      t[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+                const char *const s[2] = { vert_source,      frag_source        };
+
+                i = add(2, t, s, defines);
+            }
+
+            free(frag_source);
+            free(vert_source);
+
+            return i;
+        }
+
+        /// Begin compiling all added programs.
+
+        void start(std::function<void(bool)> share = nullptr)
+        {
+            if (has_extension("GL_KHR_parallel_shader_compile") ||
+                has_extension("GL_ARB_parallel_shader_compile"))
+            {
+                mode = parallel;
+                issue();
+            }
+            else if (share)
+            {
+                mode = threaded;
+                worker = std::thread([this, share]()
+                {
+                    share(true);
+                    issue();
+                    complete();
+                    glFinish();
+                    share(false);
+                    done = true;
+                });
+            }
+            else
+            {
+                mode = deferred;
+                issue();
+            }
+        }
+
+        /// Return true if all programs are complete, without blocking when
+        /// compiling in parallel or on a worker thread.
+
+        bool ready()
+        {
+            switch (mode)
+            {
+            case parallel:
+                for (size_t i = 0; i < entries.size(); i++)
+                {
+                    GLint s = 0;
+
+                    if (entries[i].program)
+                        glGetProgramiv(entries[i].program,
+                                       GL_COMPLETION_STATUS_KHR, &s);
+                    if (entries[i].program && !s)
+                        return false;
+                }
+                complete();
+                return true;
+
+            case threaded:
+                if (!done)
+                    return false;
+                worker.join();
+                mode = idle;
+                return true;
+
+            case deferred:
+                complete();
+                return true;
+
+            default:
+                return true;
+            }
+        }
+
+        /// Wait for all programs to complete. Return the number that failed.
+
+        int finish()
+        {
+            if (mode == threaded)
+            {
+                worker.join();
+                mode = idle;
+            }
+            else ready();
+
+            int n = 0;
+
+            for (size_t i = 0; i < entries.size(); i++)
+                if (entries[i].program == 0)
+                    n++;
+
+            return n;
+        }
+
+        /// Return program i, or 0 if it failed or is not yet complete.
+
+        GLuint get(int i) const
+        {
+            return (mode == idle && i >= 0) ? entries[i].program : 0;
+        }
+
+    private:
+
+        struct entry
+        {
+            std::vector<GLenum>      types;
+            std::vector<std::string> sources;
+            std::vector<GLuint>      shaders;
+            GLuint                   program;
+        };
+
+        /// Issue all compiles, then all links, querying nothing.
+
+        void issue()
+        {
+            for (size_t i = 0; i < entries.size(); i++)
+                for (size_t j = 0; j < entries[i].sources.size(); j++)
+                {
+                    const GLchar *s = entries[i].sources[j].c_str();
+
+                    if (GLuint shader = glCreateShader(entries[i].types[j]))
+                    {
+                        glShaderSource (shader, 1, &s, NULL);
+                        glCompileShader(shader);
+                        entries[i].shaders.push_back(shader);
+                    }
+                }
+
+            for (size_t i = 0; i < entries.size(); i++)
+                if ((entries[i].program = glCreateProgram()))
+                {
+                    for (size_t j = 0; j < entries[i].shaders.size(); j++)
+                        glAttachShader(entries[i].program, entries[i].shaders[j]);
+
+                    glLinkProgram(entries[i].program);
+                }
+        }
+
+        /// Check every status, reporting and deleting failures, and release
+        /// all shader objects.
+
+        void complete()
+        {
+            for (size_t i = 0; i < entries.size(); i++)
+            {
+                entry& e = entries[i];
+
+                bool ok = (e.program != 0 && e.shaders.size() == e.sources.size());
+
+                for (size_t j = 0; j < e.shaders.size(); j++)
+                    ok = report_shader_status(e.shaders[j]) && ok;
+
+                if (ok)
+                    ok = report_program_status(e.program);
+
+                for (size_t j = 0; j < e.shaders.size(); j++)
+                {
+                    if (e.program)
+                        glDetachShader(e.program, e.shaders[j]);
+                    glDeleteShader(e.shaders[j]);
+                }
+                e.shaders.clear();
+
+                if (!ok && e.program)
+                {
+                    glDeleteProgram(e.program);
+                    e.program = 0;
+                }
+            }
+            if (mode != threaded)
+                mode = idle;
+        }
+
+        enum { idle, parallel, threaded, deferred };
+
+        std::vector<entry> entries;
+        std::thread        worker;
+        int                mode;
+        std::atomic<bool>  done;
+    };
+
+    //--------------------------------------------------------------------------
+
+    /// A perfect hash of a fixed set of names, mapping each to its index with
+    /// two hashes and one string comparison. Names are hashed into buckets of
+    /// a few each, and each bucket is given a seed that places its names in
+    /// free slots, largest buckets first.
+
+    struct name_table
+    {
+        std::vector<unsigned long long> seeds;
+        std::vector<int>                slots;
+
+        /// Find bucket seeds placing each of the given names in its own slot.
+        /// A repeated name is placed once, at its first index. If no seeds
+        /// are found within a bounded table size, lookups fall back to a
+        /// linear search.
+
+        void build(const std::vector<std::string>& names)
+        {
+            const size_t n = names.size();
+
+            size_t m = 1;
+
+            while (m < 2 * n)
+                m *= 2;
+
+            seeds.assign(n / 4 + 1, 0);
+            slots.clear();
+
+            std::vector<std::vector<int> > buckets(seeds.size());
+            std::vector<size_t>            order  (seeds.size());
+
+            // Equal names share a bucket, so duplicates are found there.
+
+            for (size_t i = 0; i < n; i++)
+            {
+                std::vector<int>& B = buckets[bucket(names[i].c_str())];
+
+                size_t j = 0;
+
+                while (j < B.size() && names[B[j]] != names[i])
+                    j++;
+
+                if (j == B.size())
+                    B.push_back(int(i));
+            }
+
+            for (size_t i = 0; i < order.size(); i++)
+                order[i] = i;
+
+            std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+            {
+                return buckets[a].size() > buckets[b].size();
+            });
+
+            for (int tries = 0; tries < 8; tries++, m *= 2)
+            {
+                bool done = true;
+
+                slots.assign(m, -1);
+
+                for (size_t k = 0; done && k < order.size(); k++)
+                {
+                    const std::vector<int>& B = buckets[order[k]];
+
+                    unsigned long long& d = seeds[order[k]];
+
+                    for (d = 1; d < 65536; d++)
+                    {
+                        size_t j = 0;
+
+                        for (; j < B.size(); j++)
+                        {
+                            int& e = slots[slot(names[B[j]].c_str(), d)];
+
+                            if (e >= 0)
+                                break;
+                            e = B[j];
+                        }
+                        if (j == B.size())
+                            break;
+
+                        while (j-- > 0)
+                            slots[slot(names[B[j]].c_str(), d)] = -1;
+                    }
+                    done = (d < 65536);
+                }
+                if (done)
+                    return;
+            }
+            slots.clear();
+        }
+
+        /// Return the index of the named entry of names, or -1.
+
+        int find(const char *name, const std::vector<std::string>& names) const
+        {
+            if (slots.empty())
+            {
+                for (size_t i = 0; i < names.size(); i++)
+                    if (names[i] == name)
+                        return int(i);
+                return -1;
+            }
+
+            const int i = slots[slot(name, seeds[bucket(name)])];
+
+            return (i >= 0 && names[i] == name) ? i : -1;
+        }
+
+    private:
+
+        size_t bucket(const char *name) const
+        {
+            return size_t(hash(name, strlen(name)) % seeds.size());
+        }
+
+        size_t slot(const char *name, unsigned long long d) const
+        {
+            return size_t(hash(name, strlen(name), d * 1099511628211ULL))
+                 & (slots.size() - 1);
+        }
+    };
+
+    /// An active uniform, attribute, or uniform block of a program. For blocks,
+    /// location is the block index, type is zero, and size is in bytes.
+
+    struct program_variable
+    {
+        std::string name;
+        GLint       location;
+        GLenum      type;
+        GLint       size;
+    };
+
+    /// A program with tables of its active uniforms, attributes, and uniform
+    /// blocks, gathered once when it is linked. Names are found by perfect
+    /// hashing, so that they may be resolved to indices once and then set
+    /// without string handling or queries in the draw loop. Array uniforms
+    /// are named without their [0]. Setters apply to the program in use and
+    /// ignore an index of -1, as GL ignores a location of -1.
+
+    class shader_program
+    {
+    public:
+
+        /// Reflect the given program object, which is not owned.
+
+        shader_program(GLuint p = 0)
+        {
+            reflect(p);
+        }
+
+        /// Reflect the given program object, replacing all tables.
+
+        void reflect(GLuint p)
+        {
+            const GLsizei m = 256;
+
+            GLchar  s[m];
+            GLint   n = 0;
+            GLint   z;
+            GLenum  t;
+            GLsizei l;
+
+            program = p;
+            uniforms  .clear();
+            attributes.clear();
+            blocks    .clear();
+
+            if (p)
+            {
+                glGetProgramiv(p, GL_ACTIVE_UNIFORMS, &n);
+
+                for (GLint i = 0; i < n; i++)
+                {
+                    glGetActiveUniform(p, GLuint(i), m, &l, &z, &t, s);
+
+                    if (l > 3 && strcmp(s + l - 3, "[0]") == 0)
+                        s[l - 3] = 0;
+
+                    GLint k = glGetUniformLocation(p, s);
+
+                    if (k >= 0)
+                        add(uniforms, s, k, t, z);
+                }
+
+                glGetProgramiv(p, GL_ACTIVE_ATTRIBUTES, &n);
+
+                for (GLint i = 0; i < n; i++)
+                {
+                    glGetActiveAttrib(p, GLuint(i), m, &l, &z, &t, s);
+                    add(attributes, s, glGetAttribLocation(p, s), t, z);
+                }
+
+                glGetProgramiv(p, GL_ACTIVE_UNIFORM_BLOCKS, &n);
+
+                for (GLint i = 0; i < n; i++)
+                {
+                    glGetActiveUniformBlockName(p, GLuint(i), m, &l, s);
+                    glGetActiveUniformBlockiv  (p, GLuint(i),
+                                                GL_UNIFORM_BLOCK_DATA_SIZE, &z);
+                    add(blocks, s, i, 0, z);
+                }
+            }
+
+            index(uniforms,   uniform_names,   uniform_table);
+            index(attributes, attribute_names, attribute_table);
+            index(blocks,     block_names,     block_table);
+        }
+
+        GLuint get() const { return program; }
+
+        /// Return the index of the named uniform, attribute, or block, or -1.
+
+        int uniform  (const char *name) const
+        {
+            return uniform_table.find(name, uniform_names);
+        }
+        int attribute(const char *name) const
+        {
+            return attribute_table.find(name, attribute_names);
+        }
+        int block    (const char *name) const
+        {
+            return block_table.find(name, block_names);
+        }
+
+        /// Return the location of the named uniform or attribute, or -1.
+
+        GLint uniform_location(const char *name) const
+        {
+            const int i = uniform(name);
+            return (i < 0) ? -1 : uniforms[i].location;
+        }
+
+        GLint attribute_location(const char *name) const
+        {
+            const int i = attribute(name);
+            return (i < 0) ? -1 : attributes[i].location;
+        }
+
+        /// Bind uniform block i to the given binding point.
+
+        void bind_block(int i, GLuint binding) const
+        {
+            if (i >= 0) glUniformBlockBinding(program, GLuint(blocks[i].location),
+                                              binding);
+        }
+
+        const std::vector<program_variable>& get_uniforms()   const { return uniforms;   }
+        const std::vector<program_variable>& get_attributes() const { return attributes; }
+        const std::vector<program_variable>& get_blocks()     const { return blocks;     }
+
+        /// Set uniform i to the given value, or to the array of n values at v.
+
+        void set(int i, GLint   v) const { if (i >= 0) glUniform1i(uniforms[i].location, v); }
+        void set(int i, GLfloat v) const { if (i >= 0) glUniform1f(uniforms[i].location, v); }
+
+        void set(int i, const vec2& v) const { set(i, &v, 1); }
+        void set(int i, const vec3& v) const { set(i, &v, 1); }
+        void set(int i, const vec4& v) const { set(i, &v, 1); }
+        void set(int i, const mat3& M) const { set(i, &M, 1); }
+        void set(int i, const mat4& M) const { set(i, &M, 1); }
+
+        void set(int i, const vec2 *v, int n) const
+        {
+            if (i >= 0) glUniform2fv(uniforms[i].location, n, (const GLfloat *) v);
+        }
+        void set(int i, const vec3 *v, int n) const
+        {
+            if (i >= 0) glUniform3fv(uniforms[i].location, n, (const GLfloat *) v);
+        }
+        void set(int i, const vec4 *v, int n) const
+        {
+            if (i >= 0) glUniform4fv(uniforms[i].location, n, (const GLfloat *) v);
+        }
+        void set(int i, const mat3 *M, int n) const
+        {
+            if (i >= 0) glUniformMatrix3fv(uniforms[i].location, n, GL_TRUE,
+                                           (const GLfloat *) M);
+        }
+        void set(int i, const mat4 *M, int n) const
+        {
+            if (i >= 0) glUniformMatrix4fv(uniforms[i].location, n, GL_TRUE,
+                                           (const GLfloat *) M);
+        }
+
+        /// Set the named uniform, for use outside of the draw loop.
+
+        template <typename T> void set(const char *name, const T& v) const
+        {
+            set(uniform(name), v);
+        }
+
+    private:
+
+        static void add(std::vector<program_variable>& v, const char *name,
+                        GLint location, GLenum type, GLint size)
+        {
+            program_variable p;
+
+            p.name     = name;
+            p.location = location;
+            p.type     = type;
+            p.size     = size;
+
+            v.push_back(p);
+        }
+
+        static void index(const std::vector<program_variable>& v,
+                          std::vector<std::string>& names, name_table& table)
+        {
+            names.clear();
+
+            for (size_t i = 0; i < v.size(); i++)
+                names.push_back(v[i].name);
+
+            table.build(names);
+        }
+
+        GLuint program;
+
+        std::vector<program_variable> uniforms;
+        std::vector<program_variable> attributes;
+        std::vector<program_variable> blocks;
+
+        std::vector<std::string> uniform_names;
+        std::vector<std::string> attribute_names;
+        std::vector<std::string> block_names;
+
+        name_table uniform_table;
+        name_table attribute_table;
+        name_table block_table;
+    };
+
+    //--------------------------------------------------------------------------
+
+    /// A builder of uniform block data in the std140 or std430 layout. Values
+    /// are appended in declaration order, each aligned as the layout requires.
+    /// Matrices are written column-major, as GLSL expects by default, with
+    /// each mat3 column padded to four floats. In std140, every element of an
+    /// array is padded to a multiple of four floats. In std430, only arrays of
+    /// 16-byte aligned elements are, so a vec3 array has a stride of 16.
+
+    class uniform_packer
+    {
+    public:
+
+        uniform_packer(bool s = false) : std430(s)
+        {
+        }
+
+        uniform_packer& put(GLfloat v) { return put(&v, 1, 4, 4); }
+        uniform_packer& put(GLint   v) { return put(&v, 1, 4, 4); }
+        uniform_packer& put(const vec2& v) { return put(&v[0], 2,  8,  8); }
+        uniform_packer& put(const vec3& v) { return put(&v[0], 3, 16, 12); }
+        uniform_packer& put(const vec4& v) { return put(&v[0], 4, 16, 16); }
+
+        uniform_packer& put(const mat3& M)
+        {
+            for (int j = 0; j < 3; j++)
+                put(vec3(M[0][j], M[1][j], M[2][j]));
+            return align(16);
+        }
+
+        uniform_packer& put(const mat4& M)
+        {
+            for (int j = 0; j < 4; j++)
+                put(vec4(M[0][j], M[1][j], M[2][j], M[3][j]));
+            return *this;
+        }
+
+        /// Append an array of n values.
+
+        template <typename T> uniform_packer& put(const T *v, int n)
+        {
+            const bool pad = !std430 || base(v[0]) == 16;
+
+            for (int i = 0; i < n; i++)
+            {
+                if (pad) align(16);
+                put(v[i]);
+            }
+            return pad ? align(16) : *this;
+        }
+
+        /// Pad to a multiple of a bytes, e.g. 16 before a nested struct.
+
+        uniform_packer& align(size_t a)
+        {
+            data.resize((data.size() + a - 1) / a * a);
+            return *this;
+        }
+
+        void clear() { data.clear(); }
+
+        const void *get_data() const { return data.empty() ? 0 : &data[0]; }
+        size_t      get_size() const { return data.size(); }
+
+    private:
+
+        /// Return the base alignment of a value in bytes.
+
+        static size_t base(GLfloat)     { return 4; }
+        static size_t base(GLint)       { return 4; }
+        static size_t base(const vec2&) { return 8; }
+
+        template <typename T> static size_t base(const T&) { return 16; }
+
+        uniform_packer& put(const void *p, int n, size_t a, size_t z)
+        {
+            align(a);
+
+            const size_t o = data.size();
+
+            data.resize(o + z);
+            memcpy(&data[o], p, 4 * n);
+
+            return *this;
+        }
+
+        bool std430;
+        std::vector<unsigned char> data;
+    };
+
+    /// A uniform buffer written once per frame and bound to a fixed binding
+    /// point, so that data shared by all programs is uploaded once rather
+    /// than once per program. Where GL_ARB_buffer_storage is available the
+    /// buffer is a ring of n regions mapped persistently, each fenced until
+    /// the frame reading it completes. Otherwise the buffer is orphaned and
+    /// mapped anew each frame. The buffer is created on first write, so the
+    /// ring may be constructed before the context.
+
+    class uniform_ring
+    {
+    public:
+
+        uniform_ring(GLuint b = 0, int n = 3) :
+            binding(b), buffer(0), region(0), slot(0), map(0),
+            fences(n, GLsync(0))
+        {
+        }
+
+       ~uniform_ring()
+        {
+            destroy();
+        }
+
+        /// Copy z bytes from p into the next region and bind it. Nothing is
+        /// done if z is zero.
+
+        void write(const void *p, size_t z)
+        {
+            if (z == 0)
+                return;
+
+            if (buffer == 0 || z > region)
+                create(z);
+
+            if (map)
+            {
+                // Fence the region of the previous frame, then move on and
+                // wait until the GPU has finished with the next one.
+
+                const int n = int(fences.size());
+                const int prev = (slot + n - 1) % n;
+
+                if (fences[prev] == 0)
+                    fences[prev] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+                if (fences[slot])
+                {
+                    glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT,
+                                     GLuint64(1000000000));
+                    glDeleteSync(fences[slot]);
+                    fences[slot] = 0;
+                }
+
+                memcpy((char *) map + region * slot, p, z);
+                glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer,
+                                  GLintptr(region * slot), GLsizeiptr(z));
+                slot = (slot + 1) % n;
+            }
+            else
+            {
+                glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+                glBufferData(GL_UNIFORM_BUFFER, GLsizeiptr(region), 0, GL_STREAM_DRAW);
+
+                if (void *q = glMapBufferRange(GL_UNIFORM_BUFFER, 0, GLsizeiptr(z),
+                                               GL_MAP_WRITE_BIT |
+                                               GL_MAP_INVALIDATE_BUFFER_BIT))
+                {
+                    memcpy(q, p, z);
+                    glUnmapBuffer(GL_UNIFORM_BUFFER);
+                }
+                glBindBuffer(GL_UNIFORM_BUFFER, 0);
+                glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer,
+                                  0, GLsizeiptr(z));
+            }
+        }
+
+        void write(const uniform_packer& p)
+        {
+            write(p.get_data(), p.get_size());
+        }
+
+        /// Release the buffer. Requires the context.
+
+        void destroy()
+        {
+            for (size_t i = 0; i < fences.size(); i++)
+                if (fences[i])
+                {
+                    glDeleteSync(fences[i]);
+                    fences[i] = 0;
+                }
+
+            if (buffer)
+            {
+                if (map)
+                {
+                    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+                    glUnmapBuffer(GL_UNIFORM_BUFFER);
+                    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+                }
+                glDeleteBuffers(1, &buffer);
+            }
+            buffer = 0;
+            region = 0;
+            slot   = 0;
+            map    = 0;
+        }
+
+        GLuint get_binding() const { return binding; }
+
+    private:
+
+        void create(size_t z)
+        {
+            GLint a = 256;
+
+            destroy();
+
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &a);
+
+            region = (z + size_t(a) - 1) / size_t(a) * size_t(a);
+
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+#ifdef GL_MAP_PERSISTENT_BIT
+            if (has_extension("GL_ARB_buffer_storage"))
+            {
+                const GLbitfield f = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT
+                                                      | GL_MAP_COHERENT_BIT;
+                const GLsizeiptr n = GLsizeiptr(region * fences.size());
+
+                glBufferStorage(GL_UNIFORM_BUFFER, n, 0, f);
+                map = glMapBufferRange(GL_UNIFORM_BUFFER, 0, n, f);
+            }
+#endif
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+
+        GLuint binding;
+        GLuint buffer;
+        size_t region;
+        int    slot;
+        void  *map;
+
+        std::vector<GLsync> fences;
+    };
+
+    //--------------------------------------------------------------------------
+
+    /// The variants of one vertex and fragment shader pair selected by a set
+    /// of up to 64 feature flags, each defined as 1 when set. A variant is
+    /// compiled only when first requested. A flag is defined only in stages
+    /// whose source mentions it, and variants with identical sources share
+    /// one program, so flags without effect cost nothing. Requested variants
+    /// may be saved and compiled in the background at the next start. If a
+    /// program_cache is given, programs are loaded from and stored to it.
+
+    class shader_variants
+    {
+    public:
+
+        /// Create the variants of the given sources with the named features,
+        /// assigned bits in order.
+
+        shader_variants(const char *vert_source, const char *frag_source,
+                        const std::vector<std::string>& names,
+                        program_cache *c = 0) :
+            features(names), cache(c), compiled(0), shared(0)
+        {
+            sources[0] = vert_source;
+            sources[1] = frag_source;
+        }
+
+        /// Return the bit of the named feature, or 0 if unknown.
+
+        unsigned long long feature(const char *name) const
+        {
+            for (size_t i = 0; i < features.size() && i < 64; i++)
+                if (features[i] == name)
+                    return 1ULL << i;
+
+            return 0;
+        }
+
+        /// Return the variant with the given features, compiling it if
+        /// needed. Return 0 on failure.
+
+        GLuint get(unsigned long long mask)
+        {
+            auto i = variants.find(mask);
+
+            if (i != variants.end())
+                return i->second;
+
+            used.insert(mask);
+
+            std::string v, f;
+
+            const unsigned long long k = source(mask, v, f);
+
+            collect(k);
+
+            auto j = programs.find(k);
+
+            if (j != programs.end())
+                shared++;
+            else
+            {
+                const GLenum      t[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+                const char *const s[2] = { v.c_str(),        f.c_str()          };
+
+                GLuint program = cache ? cache->init_program(2, t, s)
+                                       : link_program(2, t, s);
+                compiled++;
+                j = programs.insert(std::make_pair(k, program)).first;
+            }
+            return variants[mask] = j->second;
+        }
+
+        /// Write the features of every variant requested so far to the named
+        /// file. Return 0 on success and -1 on failure.
+
+        int save_usage(const char *filename) const
+        {
+            int err = -1;
+
+            if (FILE *stream = fopen(filename, "w"))
+            {
+                err = 0;
+
+                for (auto i = used.begin(); i != used.end(); ++i)
+                    if (fprintf(stream, "%016llx\n", *i) < 0)
+                        err = -1;
+
+                if (fclose(stream))
+                    err = -1;
+            }
+            return err;
+        }
+
+        /// Begin compiling the variants listed in the named file as a batch,
+        /// as program_batch does with the given share function. Variants
+        /// requested before the batch completes wait for it. Call this once,
+        /// before requesting any variant.
+
+        void prewarm(const char *filename, std::function<void(bool)> share = nullptr)
+        {
+            if (FILE *stream = fopen(filename, "r"))
+            {
+                unsigned long long mask;
+
+                while (fscanf(stream, "%llx", &mask) == 1)
+                {
+                    std::string v, f;
+
+                    const unsigned long long k = source(mask, v, f);
+
+                    if (programs.count(k) == 0 && pending.count(k) == 0)
+                    {
+                        const GLenum      t[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+                        const char *const s[2] = { v.c_str(),        f.c_str()          };
+
+                        pending[k] = batch.add(2, t, s);
+                    }
+                }
+                fclose(stream);
+
+                if (!pending.empty())
+                    batch.start(share);
+            }
+        }
+
+        /// Adopt the prewarmed variants if the batch is complete, without
+        /// blocking. Call this between frames.
+
+        void poll()
+        {
+            if (!pending.empty() && batch.ready())
+                collect(0);
+        }
+
+        /// Delete all variants. Requires the context.
+
+        void clear()
+        {
+            if (!pending.empty())
+                collect(pending.begin()->first);
+
+            for (auto i = programs.begin(); i != programs.end(); ++i)
+                glDeleteProgram(i->second);
+
+            programs.clear();
+            variants.clear();
+        }
+
+        int get_compiled() const { return compiled; }
+        int get_shared()   const { return shared;   }
+
+    private:
+
+        /// Find the sources of the variant with the given features. Return
+        /// their hash.
+
+        unsigned long long source(unsigned long long mask,
+                                  std::string& v, std::string& f) const
+        {
+            std::string d[2];
+
+            for (size_t i = 0; i < features.size() && i < 64; i++)
+                if (mask & (1ULL << i))
+                    for (int j = 0; j < 2; j++)
+                        if (sources[j].find(features[i]) != std::string::npos)
+                            d[j] += "#define " + features[i] + " 1\n";
+
+            v = insert_defines(sources[0], d[0]);
+            f = insert_defines(sources[1], d[1]);
+
+            return hash(f.c_str(), f.size() + 1, hash(v.c_str(), v.size() + 1));
+        }
+
+        /// Adopt the prewarmed variants, waiting for the batch if it holds
+        /// the variant with hash k.
+
+        void collect(unsigned long long k)
+        {
+            if (pending.empty() || (k && pending.count(k) == 0 && !batch.ready()))
+                return;
+
+            batch.finish();
+
+            for (auto i = pending.begin(); i != pending.end(); ++i)
+            {
+                programs[i->first] = batch.get(i->second);
+                compiled++;
+            }
+            pending.clear();
+        }
+
+        std::string                    sources[2];
+        std::vector<std::string>       features;
+        program_cache                 *cache;
+
+        std::map<unsigned long long, GLuint> variants;
+        std::map<unsigned long long, GLuint> programs;
+        std::map<unsigned long long, int>    pending;
+        std::set<unsigned long long>         used;
+
+        program_batch batch;
+
+        int compiled;
+        int shared;
+    };
+
+    //--------------------------------------------------------------------------
+
+    /// A cache of compiled shader objects keyed by stage and source, so that
+    /// programs sharing a stage compile it once. Shaders are reference
+    /// counted, and each program linked here holds a reference to each of
+    /// its shaders until deleted here. All calls require the context.
+
+    class shader_cache
+    {
+    public:
+
+        shader_cache() : compiles(0), reuses(0)
+        {
+        }
+
+        /// Return a shader of the given type and source, compiling it only if
+        /// no such shader is held, and add a reference. Return 0 on failure.
+
+        GLuint acquire(GLenum type, const char *source)
+        {
+            const unsigned long long k = hash(source, strlen(source) + 1,
+                                              hash(&type, sizeof (GLenum)));
+            auto i = shaders.find(k);
+
+            if (i != shaders.end())
+            {
+                i->second.refs++;
+                reuses++;
+                return i->second.shader;
+            }
+
+            compiles++;
+
+            GLuint shader = init_shader(type, source);
+
+            if (shader)
+            {
+                entry e = { shader, 1 };
+
+                shaders[k]   = e;
+                keys[shader] = k;
+            }
+            return shader;
+        }
+
+        /// Drop a reference to the given shader, deleting it with the last.
+
+        void release(GLuint shader)
+        {
+            auto i = keys.find(shader);
+
+            if (i != keys.end())
+            {
+                auto j = shaders.find(i->second);
+
+                if (--j->second.refs == 0)
+                {
+                    glDeleteShader(shader);
+                    shaders.erase(j);
+                    keys.erase(i);
+                }
+            }
+        }
+
+        /// Link and return a program of the n shaders of the given types and
+        /// sources, acquiring each. Return 0 on failure.
+
+        GLuint init_program(int n, const GLenum *types,
+                            const char *const *sources)
+        {
+            std::vector<GLuint> v;
+            GLuint program = 0;
+
+            for (int i = 0; i < n; i++)
+                if (GLuint shader = acquire(types[i], sources[i]))
+                    v.push_back(shader);
+
+            if (int(v.size()) == n && (program = glCreateProgram()))
+            {
+                for (int i = 0; i < n; i++)
+                    glAttachShader(program, v[i]);
+
+                glLinkProgram(program);
+
+                for (int i = 0; i < n; i++)
+                    glDetachShader(program, v[i]);
+
+                if (report_program_status(program))
+                    programs[program] = v;
+                else
+                {
+                    glDeleteProgram(program);
+                    program = 0;
+                }
+            }
+            if (program == 0)
+                for (size_t i = 0; i < v.size(); i++)
+                    release(v[i]);
+
+            return program;
+        }
+
+        /// Link and return a program using the named vertex and fragment
+        /// shader source files, as does the init_program function.
+
+        GLuint init_program(const char *vert_filename, const char *frag_filename)
+        {
+            GLuint program = 0;
+
+            char *vert_source = read_shader_source(vert_filename);
+            char *frag_source = read_shader_source(frag_filename);
+
+            if (vert_source && frag_source)
+            {
+                const GLenum      t[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+                const char *const s[2] = { vert_source,      frag_source        };
+
+                program = init_program(2, t, s);
+            }
+
+            free(frag_source);
+            free(vert_source);
+
+            return program;
+        }
+
+        /// Delete a program linked here, releasing its shaders.
+
+        void delete_program(GLuint program)
+        {
+            auto i = programs.find(program);
+
+            if (i != programs.end())
+            {
+                for (size_t j = 0; j < i->second.size(); j++)
+                    release(i->second[j]);
+
+                programs.erase(i);
+                glDeleteProgram(program);
+            }
+        }
+
+        /// Delete all programs linked here and all shaders.
+
+        void clear()
+        {
+            for (auto i = programs.begin(); i != programs.end(); ++i)
+                glDeleteProgram(i->first);
+
+            for (auto i = shaders.begin(); i != shaders.end(); ++i)
+                glDeleteShader(i->second.shader);
+
+            programs.clear();
+            shaders .clear();
+            keys    .clear();
+        }
+
+        int get_compiles() const { return compiles;            }
+        int get_reuses()   const { return reuses;              }
+        int get_count()    const { return int(shaders.size()); }
+
+    private:
+
+        struct entry
+        {
+            GLuint shader;
+            int    refs;
+        };
+
+        std::map<unsigned long long, entry>    shaders;
+        std::map<GLuint, unsigned long long>   keys;
+        std::map<GLuint, std::vector<GLuint> > programs;
+
+        int compiles;
+        int reuses;
+    };
+
+    //--------------------------------------------------------------------------
+
+    /// Return the program pipeline stage bit of the given shader type.
+
+    inline GLbitfield stage_bit(GLenum type)
+    {
+        switch (type)
+        {
+        case GL_VERTEX_SHADER:          return GL_VERTEX_SHADER_BIT;
+        case GL_FRAGMENT_SHADER:        return GL_FRAGMENT_SHADER_BIT;
+        case GL_GEOMETRY_SHADER:        return GL_GEOMETRY_SHADER_BIT;
+        case GL_TESS_CONTROL_SHADER:    return GL_TESS_CONTROL_SHADER_BIT;
+        case GL_TESS_EVALUATION_SHADER: return GL_TESS_EVALUATION_SHADER_BIT;
+        }
+        return 0;
+    }
+
+    /// Compile and link a separable program of one stage using the given
+    /// GLSL source string. Return 0 on failure.
+
+    inline GLuint init_separable(GLenum type, const char *source)
+    {
+        GLuint program = glCreateShaderProgramv(type, 1, (const GLchar **) &source);
+
+        if (program && !report_program_status(program))
+        {
+            glDeleteProgram(program);
+            program = 0;
+        }
+        return program;
+    }
+
+    /// A cache of separable single-stage programs and of the program pipeline
+    /// objects combining them, so that each stage is linked once and each
+    /// combination is assembled once. The number of links is then the sum of
+    /// the numbers of stages rather than their product. Requires OpenGL 4.1
+    /// or GL_ARB_separate_shader_objects. Vertex stages of GLSL 4.10 and
+    /// later must redeclare gl_PerVertex. Uniforms of a stage are set with
+    /// glProgramUniform, or by shader_program after glActiveShaderProgram.
+
+    class pipeline_cache
+    {
+    public:
+
+        pipeline_cache() : links(0)
+        {
+        }
+
+        /// Return a separable program of the given type and source, linking
+        /// it only if no such program is held. Return 0 on failure.
+
+        GLuint stage(GLenum type, const char *source)
+        {
+            const unsigned long long k = hash(source, strlen(source) + 1,
+                                              hash(&type, sizeof (GLenum)));
+            auto i = stages.find(k);
+
+            if (i != stages.end())
+                return i->second;
+
+            links++;
+
+            GLuint program = init_separable(type, source);
+
+            if (program)
+            {
+                stages[k]      = program;
+                types[program] = type;
+            }
+            return program;
+        }
+
+        /// Return a separable program using the named shader source file.
+
+        GLuint load(GLenum type, const char *filename)
+        {
+            GLuint program = 0;
+
+            if (char *source = read_shader_source(filename))
+            {
+                program = stage(type, source);
+                free(source);
+            }
+            return program;
+        }
+
+        /// Return the pipeline combining the n given stage programs, which
+        /// must come from this cache, creating it if needed.
+
+        GLuint get(int n, const GLuint *programs)
+        {
+            std::vector<GLuint> v(programs, programs + n);
+
+            std::sort(v.begin(), v.end());
+
+            const unsigned long long k = hash(v.data(), sizeof (GLuint) * n);
+
+            auto i = pipelines.find(k);
+
+            if (i != pipelines.end())
+                return i->second;
+
+            GLuint pipeline = 0;
+
+            glGenProgramPipelines(1, &pipeline);
+
+            for (int j = 0; j < n; j++)
+                glUseProgramStages(pipeline, stage_bit(types[v[j]]), v[j]);
+
+            return pipelines[k] = pipeline;
+        }
+
+        /// Return the pipeline combining the given vertex and fragment stages.
+
+        GLuint get(GLuint vert, GLuint frag)
+        {
+            const GLuint v[2] = { vert, frag };
+            return get(2, v);
+        }
+
+        /// Make the given pipeline current. A program in use would override
+        /// it, so none is.
+
+        static void bind(GLuint pipeline)
+        {
+            glUseProgram(0);
+            glBindProgramPipeline(pipeline);
+        }
+
+        /// Delete all pipelines and stage programs.
+
+        void clear()
+        {
+            for (auto i = pipelines.begin(); i != pipelines.end(); ++i)
+                glDeleteProgramPipelines(1, &i->second);
+
+            for (auto i = stages.begin(); i != stages.end(); ++i)
+                glDeleteProgram(i->second);
+
+            pipelines.clear();
+            stages   .clear();
+            types    .clear();
+        }
+
+        int get_links()     const { return links;                 }
+        int get_pipelines() const { return int(pipelines.size()); }
+
+    private:
+
+        std::map<unsigned long long, GLuint> stages;
+        std::map<unsigned long long, GLuint> pipelines;
+        std::map<GLuint, GLenum>             types;
+
+        int links;
+    };
+
+    //--------------------------------------------------------------------------
+
+    /// Return the shader type implied by the extension of the named file, or
+    /// 0 if unknown.
+
+    inline GLenum shader_type(const char *filename)
+    {
+        const char *e = strrchr(filename, '.');
+
+        if (e)
+        {
+            if (!strcmp(e, ".vert") || !strcmp(e, ".vs")) return GL_VERTEX_SHADER;
+            if (!strcmp(e, ".frag") || !strcmp(e, ".fs")) return GL_FRAGMENT_SHADER;
+            if (!strcmp(e, ".geom") || !strcmp(e, ".gs")) return GL_GEOMETRY_SHADER;
+            if (!strcmp(e, ".tesc")) return GL_TESS_CONTROL_SHADER;
+            if (!strcmp(e, ".tese")) return GL_TESS_EVALUATION_SHADER;
+#ifdef GL_COMPUTE_SHADER
+            if (!strcmp(e, ".comp")) return GL_COMPUTE_SHADER;
+#endif
+        }
+        return 0;
+    }
+
+    /// Write a C++ source file defining the named table of embedded_shader,
+    /// for set_embedded_shaders, holding the n named shader files and every
+    /// file they include. Each file is embedded as written, so includes are
+    /// still resolved at run time. It is keyed by its path relative to the
+    /// search path on which it was found, so the application may use other
+    /// search paths, and otherwise by its normalized path. Every include must
+    /// be found. If validate is true, each of the n shaders is
+    /// also compiled, with includes resolved, as the type implied by its
+    /// extension, which requires a context. Includes are searched for along
+    /// the paths of the given resolver, if any. Return the number of shaders
+    /// that failed, in which case nothing is written, or -1 if the output
+    /// cannot be written.
+    ///
+    /// Call this from a small tool run as a build step, so that missing or
+    /// broken shaders fail the build and the application needs no shader
+    /// file I/O at run time.
+
+    inline int embed_shaders(const char *output, const char *table,
+                             int n, const char *const *filenames,
+                             bool validate = false,
+                             shader_includes *includes = 0)
+    {
+        shader_includes local;
+        shader_includes& I = includes ? *includes : local;
+
+        std::map<std::string, std::string> names;
+
+        int failures = 0;
+
+        for (int i = 0; i < n; i++)
+        {
+            const std::string s = I.read(filenames[i]);
+
+            if (s.empty())
+            {
+                failures++;
+                continue;
+            }
+
+            std::vector<std::string> v = I.dependencies(filenames[i]);
+
+            for (size_t j = 0; j < v.size(); j++)
+                names.insert(std::make_pair(I.embedded_name(v[j].c_str()), v[j]));
+
+            if (validate)
+                if (GLenum type = shader_type(filenames[i]))
+                {
+                    if (GLuint shader = init_shader(type, s.c_str()))
+                        glDeleteShader(shader);
+                    else
+                    {
+                        fprintf(stderr, "%s: Failed to compile.\n", filenames[i]);
+                        failures++;
+                    }
+                }
+        }
+
+        if (failures)
+            return failures;
+
+        FILE *stream = fopen(output, "w");
+
+        if (stream == 0)
+            return -1;
+
+        bool ok = fprintf(stream, "// Generated by gl::embed_shaders.\n\n"
+                    "static const gl::embedded_shader %s[] =\n{\n", table) > 0;
+
+        for (auto i = names.begin(); i != names.end(); ++i)
+        {
+            char *p = read_shader_source(i->second.c_str());
+
+            std::string t = "    { \"" + i->first + "\",\n      \"";
+
+            for (const char *c = p; c && *c; c++)
+                switch (*c)
+                {
+                case '\n': t += c[1] ? "\\n\"\n      \"" : "\\n"; break;
+                case '\r': t += "\\r";  break;
+                case '\t': t += "\\t";  break;
+                case '\\': t += "\\\\"; break;
+                case '"':  t += "\\\""; break;
+                case '?':  t += "\\?";  break;
+                default:   t += *c;
+                }
+            t += "\" },\n";
+
+            ok = ok && p && fputs(t.c_str(), stream) >= 0;
+
+            free(p);
+        }
+        ok = fputs("    { 0, 0 }\n};\n", stream) >= 0 && ok;
+        ok = fclose(stream) == 0 && ok;
+
+        if (!ok)
+        {
+            remove(output);
+            return -1;
+        }
+        return 0;
+    }
+
+    //--------------------------------------------------------------------------
+}
+
+#endif
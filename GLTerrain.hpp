@@ -0,0 +1,262 @@
+// Copyright (c) 2014 Robert Kooima
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef GLTERRAIN_HPP
+#define GLTERRAIN_HPP
+
+/// This header provides the generation of chunked terrain meshes from height
+/// map images, such as 8-bit grayscale Targa files read with read_tga.
+
+//------------------------------------------------------------------------------
+
+#include "GLImage.hpp"
+
+//------------------------------------------------------------------------------
+
+namespace gl
+{
+    /// An interleaved terrain vertex.
+
+    struct terrain_vertex
+    {
+        vec3 position;
+        vec3 normal;
+        vec2 texcoord;
+    };
+
+    /// One square chunk of terrain. Column x and row y give its place in the
+    /// grid of chunks. Indices give counter-clockwise triangles.
+
+    struct terrain_chunk
+    {
+        int x;
+        int y;
+
+        std::vector<terrain_vertex> vertices;
+        std::vector<GLuint>         indices;
+    };
+
+    /// Compute the normals of the w by h height field z, with sample spacing
+    /// sx and sz and height scale sy, using a Sobel filter. Rows are spread
+    /// over all cores and interior samples are processed four at a time.
+
+    inline void terrain_normals(const float *z, int w, int h,
+                                GLfloat sx, GLfloat sy, GLfloat sz, vec3 *n)
+    {
+        const float kx = sy / (8 * sx);
+        const float kz = sy / (8 * sz);
+
+        parallel_for(h, [&](int j)
+        {
+            const float *a = z + size_t(std::max(j - 1, 0))     * w;
+            const float *b = z + size_t(j)                      * w;
+            const float *c = z + size_t(std::min(j + 1, h - 1)) * w;
+
+            vec3 *o = n + size_t(j) * w;
+
+            auto sample = [&](int i)
+            {
+                const int l = std::max(i - 1, 0);
+                const int r = std::min(i + 1, w - 1);
+
+                const float gx = (a[r] + 2 * b[r] + c[r]) - (a[l] + 2 * b[l] + c[l]);
+                const float gz = (c[l] + 2 * c[i] + c[r]) - (a[l] + 2 * a[i] + a[r]);
+
+                o[i] = normalize(vec3(-gx * kx, 1, -gz * kz));
+            };
+
+            int i = 1;
+
+            sample(0);
+#ifdef __SSE2__
+            const __m128 two = _mm_set1_ps(2.f);
+            const __m128 one = _mm_set1_ps(1.f);
+            const __m128 mx  = _mm_set1_ps(-kx);
+            const __m128 mz  = _mm_set1_ps(-kz);
+
+            for (; i + 4 < w; i += 4)
+            {
+                const __m128 al = _mm_loadu_ps(a + i - 1);
+                const __m128 am = _mm_loadu_ps(a + i);
+                const __m128 ar = _mm_loadu_ps(a + i + 1);
+                const __m128 bl = _mm_loadu_ps(b + i - 1);
+                const __m128 br = _mm_loadu_ps(b + i + 1);
+                const __m128 cl = _mm_loadu_ps(c + i - 1);
+                const __m128 cm = _mm_loadu_ps(c + i);
+                const __m128 cr = _mm_loadu_ps(c + i + 1);
+
+                const __m128 gx = _mm_sub_ps(
+                    _mm_add_ps(_mm_add_ps(ar, cr), _mm_mul_ps(two, br)),
+                    _mm_add_ps(_mm_add_ps(al, cl), _mm_mul_ps(two, bl)));
+                const __m128 gz = _mm_sub_ps(
+                    _mm_add_ps(_mm_add_ps(cl, cr), _mm_mul_ps(two, cm)),
+                    _mm_add_ps(_mm_add_ps(al, ar), _mm_mul_ps(two, am)));
+
+                const __m128 nx = _mm_mul_ps(gx, mx);
+                const __m128 nz = _mm_mul_ps(gz, mz);
+                const __m128 k  = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(one,
+                                  _mm_add_ps(_mm_mul_ps(nx, nx),
+                                             _mm_mul_ps(nz, nz)))));
+                float X[4], Y[4], Z[4];
+
+                _mm_storeu_ps(X, _mm_mul_ps(nx, k));
+                _mm_storeu_ps(Y, k);
+                _mm_storeu_ps(Z, _mm_mul_ps(nz, k));
+
+                for (int e = 0; e < 4; e++)
+                    o[i + e] = vec3(X[e], Y[e], Z[e]);
+            }
+#endif
+            for (; i < w; i++)
+                sample(i);
+        });
+    }
+
+    /// Append the indices of the quads of an m by l grid of vertices starting
+    /// at vertex v. Quads are visited in stripes a few quads wide so that
+    /// each row of vertices is still in the post-transform cache when the
+    /// next row reuses it.
+
+    inline void terrain_indices(std::vector<GLuint>& o, GLuint v, int m, int l)
+    {
+        const int k = 16;
+
+        for (int s = 0; s < m - 1; s += k)
+            for (int j = 0; j < l - 1; j++)
+                for (int i = s; i < std::min(s + k, m - 1); i++)
+                {
+                    const GLuint a = v + GLuint(j * m + i);
+                    const GLuint b = a + GLuint(m);
+
+                    o.push_back(a); o.push_back(b);     o.push_back(a + 1);
+                    o.push_back(b); o.push_back(b + 1); o.push_back(a + 1);
+                }
+    }
+
+    /// Generate a chunked grid mesh from the w by h height map image p of
+    /// depth d, using its first channel. Each chunk covers n by n quads. The
+    /// sample spacing is given by the x and z of scale, and the height range
+    /// by its y. Each chunk is ringed by a skirt hanging the given depth
+    /// below its edge, hiding cracks between chunks of differing detail.
+    /// Chunks are built in parallel. Return an empty vector on failure.
+
+    inline std::vector<terrain_chunk> make_terrain(const void *p, int w, int h,
+                                                   int d, int n,
+                                                   const vec3& scale,
+                                                   GLfloat skirt = 0)
+    {
+        std::vector<terrain_chunk> chunks;
+
+        if (p == 0 || w < 2 || h < 2 || n < 1)
+            return chunks;
+
+        const int c  = d / 8;
+        const int cw = (w - 2) / n + 1;
+        const int ch = (h - 2) / n + 1;
+
+        // Convert heights to floats and find all normals.
+
+        std::vector<float> z(size_t(w) * h);
+        std::vector<vec3>  N(size_t(w) * h);
+
+        const unsigned char *q = (const unsigned char *) p;
+
+        parallel_bands(z.size(), [&](size_t i0, size_t i1)
+        {
+            for (size_t i = i0; i < i1; i++)
+                z[i] = q[i * c] * (scale[1] / 255.f);
+        });
+
+        terrain_normals(&z[0], w, h, scale[0], 1.f, scale[2], &N[0]);
+
+        chunks.resize(size_t(cw) * ch);
+
+        parallel_for(int(chunks.size()), [&](int k)
+        {
+            terrain_chunk& C = chunks[k];
+
+            C.x = k % cw;
+            C.y = k / cw;
+
+            const int i0 = C.x * n, i1 = std::min(i0 + n, w - 1);
+            const int j0 = C.y * n, j1 = std::min(j0 + n, h - 1);
+            const int m  = i1 - i0 + 1;
+            const int l  = j1 - j0 + 1;
+
+            auto vertex = [&](int i, int j, GLfloat drop)
+            {
+                const size_t s = size_t(j) * w + i;
+
+                terrain_vertex v;
+
+                v.position = vec3(i * scale[0], z[s] - drop, j * scale[2]);
+                v.normal   = N[s];
+                v.texcoord = vec2(GLfloat(i) / (w - 1), GLfloat(j) / (h - 1));
+
+                C.vertices.push_back(v);
+            };
+
+            C.vertices.reserve(size_t(m) * l + (skirt > 0 ? 2 * (m + l) : 0));
+
+            for (int j = j0; j <= j1; j++)
+                for (int i = i0; i <= i1; i++)
+                    vertex(i, j, 0);
+
+            terrain_indices(C.indices, 0, m, l);
+
+            // Walk the perimeter counter-clockwise from above, dropping a
+            // copy of each edge vertex and joining the two with a quad.
+
+            if (skirt > 0)
+            {
+                std::vector<GLuint> ring;
+
+                for (int i = 0; i < m - 1; i++) ring.push_back(GLuint(i));
+                for (int j = 0; j < l - 1; j++) ring.push_back(GLuint(j * m + m - 1));
+                for (int i = m - 1; i > 0; i--) ring.push_back(GLuint((l - 1) * m + i));
+                for (int j = l - 1; j > 0; j--) ring.push_back(GLuint(j * m));
+
+                const GLuint base = GLuint(C.vertices.size());
+
+                for (size_t r = 0; r < ring.size(); r++)
+                {
+                    const GLuint e = ring[r];
+                    vertex(i0 + int(e) % m, j0 + int(e) / m, skirt);
+                }
+
+                for (size_t r = 0; r < ring.size(); r++)
+                {
+                    const size_t s = (r + 1) % ring.size();
+
+                    const GLuint a = ring[r], b = ring[s];
+                    const GLuint A = base + GLuint(r), B = base + GLuint(s);
+
+                    C.indices.push_back(a); C.indices.push_back(b); C.indices.push_back(A);
+                    C.indices.push_back(b); C.indices.push_back(B); C.indices.push_back(A);
+                }
+            }
+        });
+        return chunks;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,1564 @@
+// Copyright (c) 2014 Robert Kooima
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+
+#ifndef GLTEXTURE_HPP
+#define GLTEXTURE_HPP
+
+/// This header provides the means to turn decoded images into GPU-ready
+/// texture data ahead of time: packing, compression, and caching.
+
+//------------------------------------------------------------------------------
+
+#include "GLImage.hpp"
+
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <unordered_map>
+
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#  include <sys/mman.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+//------------------------------------------------------------------------------
+
+namespace gl
+{
+    /// The placement of one image within a texture atlas. Position and size
+    /// are in pixels, excluding padding. Texture coordinates span the image.
+
+    struct atlas_rect
+    {
+        int     page;
+        int     x, y, w, h;
+        GLfloat u0, v0, u1, v1;
+    };
+
+    /// A texture atlas packing many small images of equal depth into one or
+    /// more large pages. Images are placed by a skyline bottom-left packer in
+    /// order of decreasing height, so the result depends only on the inputs.
+    /// Each image is surrounded by p pixels of its own extruded edge so that
+    /// filtering does not bleed between neighbors.
+
+    class atlas
+    {
+    public:
+
+        atlas(int w, int h, int d, int p = 1) : W(w), H(h), D(d), P(p)
+        {
+        }
+
+        /// Queue the named Targa file. Return its index.
+
+        int add(const char *filename)
+        {
+            images.push_back(image());
+            images.back().name = filename;
+            return int(images.size()) - 1;
+        }
+
+        /// Queue a copy of the w by h pixel buffer p. Return its index.
+
+        int add(const void *p, int w, int h)
+        {
+            images.push_back(image());
+            images.back().w = w;
+            images.back().h = h;
+            images.back().d = D;
+
+            if (w > 0 && h > 0)
+                images.back().data.assign((const unsigned char *) p,
+                                          (const unsigned char *) p
+                                                + size_t(w) * h * D / 8);
+            return int(images.size()) - 1;
+        }
+
+        /// Load all queued files in parallel, pack, and compose the pages.
+        /// Return 0 on success and -1 if any image fails to load, has the
+        /// wrong depth, is empty, or is too large for a page.
+
+        int build()
+        {
+            int err = 0;
+
+            parallel_for(int(images.size()), [&](int i)
+            {
+                image& m = images[i];
+
+                if (!m.name.empty() && m.data.empty())
+                {
+                    if (void *p = read_tga(m.name.c_str(), m.w, m.h, m.d))
+                    {
+                        m.data.assign((unsigned char *) p,
+                                      (unsigned char *) p + m.w * m.h * m.d / 8);
+                        free(p);
+                    }
+                    else m.d = 0;
+                }
+            });
+
+            for (size_t i = 0; i < images.size(); i++)
+                if (images[i].d != D || images[i].w < 1
+                                     || images[i].h < 1
+                                     || images[i].w + 2 * P > W
+                                     || images[i].h + 2 * P > H)
+                    err = -1;
+
+            if (err == 0)
+            {
+                pack();
+                compose();
+            }
+            return err;
+        }
+
+        /// Return the number of pages, page i's pixels, and image i's placement.
+
+        int               get_pages()     const { return int(pages.size()); }
+        const void       *get_page(int i) const { return &pages[i][0]; }
+        const atlas_rect& get_rect(int i) const { return rects[i]; }
+
+        int get_w() const { return W; }
+        int get_h() const { return H; }
+        int get_d() const { return D; }
+
+        /// Return a hash of the page size and padding, and of the name,
+        /// modification time, and size of each queued file, or the pixels of
+        /// each queued buffer. This is known before build().
+
+        unsigned long long get_hash() const
+        {
+            unsigned long long k = hash(&W, sizeof (int));
+
+            k = hash(&H, sizeof (int), k);
+            k = hash(&D, sizeof (int), k);
+            k = hash(&P, sizeof (int), k);
+
+            for (size_t i = 0; i < images.size(); i++)
+            {
+                const image& m = images[i];
+
+                if (m.name.empty())
+                {
+                    k = hash(&m.w, sizeof (int), k);
+                    k = hash(&m.h, sizeof (int), k);
+
+                    if (!m.data.empty())
+                        k = hash(&m.data[0], m.data.size(), k);
+                }
+                else
+                {
+                    struct stat st;
+
+                    k = hash(m.name.c_str(), m.name.size() + 1, k);
+
+                    if (stat(m.name.c_str(), &st) == 0)
+                    {
+                        const long long t = (long long) st.st_mtime;
+                        const long long z = (long long) st.st_size;
+
+                        k = hash(&t, sizeof (t), k);
+                        k = hash(&z, sizeof (z), k);
+                    }
+                }
+            }
+            return k;
+        }
+
+        /// Write the built atlas to the named file, keyed by get_hash(). Return
+        /// 0 on success and -1 on failure.
+
+        int write(const char *filename) const
+        {
+            int err = -1;
+
+            if (FILE *stream = fopen(filename, "wb"))
+            {
+                head h;
+
+                memcpy(h.magic, "GLTA", 4);
+
+                h.version = 1;
+                h.key     = get_hash();
+                h.w       = W;
+                h.h       = H;
+                h.d       = D;
+                h.p       = P;
+                h.pages   = int(pages.size());
+                h.rects   = int(rects.size());
+
+                if (fwrite(&h, sizeof (h), 1, stream) == 1 &&
+                    fwrite(rects.data(), sizeof (atlas_rect), rects.size(),
+                            stream) == rects.size())
+                {
+                    err = 0;
+
+                    for (size_t i = 0; i < pages.size(); i++)
+                        if (fwrite(&pages[i][0], 1, pages[i].size(),
+                                    stream) != pages[i].size())
+                            err = -1;
+                }
+                fclose(stream);
+            }
+            return err;
+        }
+
+        /// Read an atlas previously written to the named file in place of
+        /// build(). The file must match the page size, padding, and queued
+        /// images, and so the hash, of this atlas. Return 0 on success and -1
+        /// if it does not or cannot be read, leaving the atlas unchanged.
+
+        int read(const char *filename)
+        {
+            int err = -1;
+
+            if (FILE *stream = fopen(filename, "rb"))
+            {
+                const size_t s = size_t(W) * H * D / 8;
+
+                head h;
+
+                bool ok = fseek(stream, 0, SEEK_END) == 0;
+
+                const long long z = ftell(stream);
+
+                ok = ok && fseek(stream, 0, SEEK_SET) == 0
+                        && fread(&h, sizeof (h), 1, stream) == 1
+                        && memcmp(h.magic, "GLTA", 4) == 0
+                        && h.version == 1
+                        && h.key     == get_hash()
+                        && h.w == W && h.h == H && h.d == D && h.p == P
+                        && h.rects == int(images.size())
+                        && h.pages >= (h.rects ? 1 : 0) && h.pages <= h.rects
+                        && z == (long long) (sizeof (h) + h.rects
+                                                 * sizeof (atlas_rect)
+                                                 + h.pages * s);
+
+                std::vector<atlas_rect> r;
+
+                if (ok)
+                {
+                    r.resize(h.rects);
+                    ok = fread(r.data(), sizeof (atlas_rect), r.size(),
+                                stream) == r.size();
+                }
+
+                for (size_t i = 0; ok && i < r.size(); i++)
+                    ok = 0 <= r[i].page && r[i].page < h.pages
+                      && 0 <  r[i].w    && 0 <  r[i].h
+                      && P <= r[i].x    && r[i].x + r[i].w + P <= W
+                      && P <= r[i].y    && r[i].y + r[i].h + P <= H;
+
+                std::vector<std::vector<unsigned char> > q;
+
+                if (ok)
+                    q.assign(h.pages, std::vector<unsigned char>(s));
+
+                for (size_t i = 0; ok && i < q.size(); i++)
+                    ok = fread(&q[i][0], 1, s, stream) == s;
+
+                if (ok)
+                {
+                    rects.swap(r);
+                    pages.swap(q);
+                    err = 0;
+                }
+                fclose(stream);
+            }
+            return err;
+        }
+
+    private:
+
+        #pragma pack(push, 1)
+        struct head
+        {
+            char               magic[4];
+            unsigned int       version;
+            unsigned long long key;
+            int w, h, d, p;
+            int pages;
+            int rects;
+        };
+        #pragma pack(pop)
+
+        struct image
+        {
+            image() : w(0), h(0), d(0) { }
+
+            std::string                name;
+            std::vector<unsigned char> data;
+            int w;
+            int h;
+            int d;
+        };
+
+        struct span
+        {
+            int x, y, w;
+        };
+
+        /// Find the lowest position at which a w by h rectangle fits on
+        /// skyline s. Return the index of its leftmost span or -1.
+
+        int fit(const std::vector<span>& s, int w, int h, int& y) const
+        {
+            int best = -1;
+
+            for (size_t i = 0; i < s.size(); i++)
+                if (s[i].x + w <= W)
+                {
+                    int top = 0;
+
+                    for (size_t j = i; j < s.size() && s[j].x < s[i].x + w; j++)
+                        top = std::max(top, s[j].y);
+
+                    if (top + h <= H && (best < 0 || top < y))
+                    {
+                        best = int(i);
+                        y    = top;
+                    }
+                }
+            return best;
+        }
+
+        /// Raise skyline s to y + h across a w-wide rectangle at span i.
+
+        void place(std::vector<span>& s, int i, int w, int h, int y) const
+        {
+            const int x0 = s[i].x;
+            const int x1 = s[i].x + w;
+
+            std::vector<span> t;
+
+            for (size_t j = 0; j < s.size(); j++)
+            {
+                const int a = s[j].x;
+                const int b = s[j].x + s[j].w;
+
+                if (a < x0)
+                {
+                    span l = { a, s[j].y, std::min(b, x0) - a };
+                    t.push_back(l);
+                }
+                if (j == size_t(i))
+                {
+                    span m = { x0, y + h, w };
+                    t.push_back(m);
+                }
+                if (b > x1)
+                {
+                    span r = { std::max(a, x1), s[j].y, b - std::max(a, x1) };
+                    t.push_back(r);
+                }
+            }
+
+            // Merge neighboring spans of equal height.
+
+            s.clear();
+
+            for (size_t j = 0; j < t.size(); j++)
+                if (!s.empty() && s.back().y == t[j].y)
+                    s.back().w += t[j].w;
+                else
+                    s.push_back(t[j]);
+        }
+
+        /// Assign every image a page and position.
+
+        void pack()
+        {
+            std::vector<int> order(images.size());
+
+            for (size_t i = 0; i < order.size(); i++)
+                order[i] = int(i);
+
+            std::stable_sort(order.begin(), order.end(), [&](int a, int b)
+            {
+                if (images[a].h != images[b].h) return images[a].h > images[b].h;
+                return images[a].w > images[b].w;
+            });
+
+            std::vector<std::vector<span> > sky;
+
+            rects.assign(images.size(), atlas_rect());
+
+            for (size_t k = 0; k < order.size(); k++)
+            {
+                const int i = order[k];
+                const int w = images[i].w + 2 * P;
+                const int h = images[i].h + 2 * P;
+
+                int p, s = -1, y = 0;
+
+                for (p = 0; p < int(sky.size()); p++)
+                    if ((s = fit(sky[p], w, h, y)) >= 0)
+                        break;
+
+                if (s < 0)
+                {
+                    span e = { 0, 0, W };
+                    sky.push_back(std::vector<span>(1, e));
+                    s = fit(sky[p], w, h, y);
+                }
+
+                atlas_rect& r = rects[i];
+
+                r.page = p;
+                r.x    = sky[p][s].x + P;
+                r.y    = y           + P;
+                r.w    = images[i].w;
+                r.h    = images[i].h;
+                r.u0   = GLfloat(r.x)       / W;
+                r.v0   = GLfloat(r.y)       / H;
+                r.u1   = GLfloat(r.x + r.w) / W;
+                r.v1   = GLfloat(r.y + r.h) / H;
+
+                place(sky[p], s, w, h, y);
+            }
+
+            pages.assign(sky.size(), std::vector<unsigned char>(W * H * D / 8, 0));
+        }
+
+        /// Copy every image into its page in parallel, extruding its edges.
+
+        void compose()
+        {
+            const int c = D / 8;
+
+            parallel_for(int(images.size()), [&](int i)
+            {
+                const atlas_rect&    r = rects[i];
+                const unsigned char *p = &images[i].data[0];
+                      unsigned char *q = &pages[r.page][0];
+
+                for (int y = -P; y < r.h + P; y++)
+                {
+                    const int sy = std::min(std::max(y, 0), r.h - 1);
+
+                    for (int x = -P; x < r.w + P; x++)
+                    {
+                        const int sx = std::min(std::max(x, 0), r.w - 1);
+
+                        memcpy(q + ((r.y + y) * W + (r.x + x)) * c,
+                               p + ( sy       * r.w +  sx)      * c, c);
+                    }
+                }
+            });
+        }
+
+        int W;
+        int H;
+        int D;
+        int P;
+
+        std::vector<image>                       images;
+        std::vector<atlas_rect>                  rects;
+        std::vector<std::vector<unsigned char> > pages;
+    };
+
+    //--------------------------------------------------------------------------
+
+    #ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+    #define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT       0x83F1
+    #define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT       0x83F3
+    #endif
+    #ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT
+    #define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT 0x8C4D
+    #define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+    #endif
+
+    /// Block compression format selectors. BC1 and BC3 encode color with one
+    /// bit or eight bits of alpha. BC4 and BC5 encode one or two channels.
+
+    enum { bc1 = 1, bc3 = 3, bc4 = 4, bc5 = 5 };
+
+    /// Return the number of bytes in one 4x4 block of format f.
+
+    inline int bc_block_size(int f)
+    {
+        return (f == bc1 || f == bc4) ? 8 : 16;
+    }
+
+    /// Return the number of bytes needed to compress a w by h image to f.
+
+    inline size_t bc_size(int w, int h, int f)
+    {
+        return size_t((w + 3) / 4) * size_t((h + 3) / 4) * bc_block_size(f);
+    }
+
+    /// Return the GL internal format of compression format f.
+
+    inline GLenum bc_format(int f, bool srgb = false)
+    {
+        switch (f)
+        {
+            case bc1: return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT
+                                  : GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+            case bc3: return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+                                  : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            case bc4: return GL_COMPRESSED_RED_RGTC1;
+            case bc5: return GL_COMPRESSED_RG_RGTC2;
+        }
+        return 0;
+    }
+
+    /// Load the 4x4 block at column bx and row by of w by h image p of depth
+    /// d as planes of red, green, blue, and alpha. Clamp at the edges. Gray
+    /// images fill red, green, and blue. Two-channel images are red-green.
+
+    inline void bc_load(const void *p, int w, int h, int d,
+                        int bx, int by, float v[4][16])
+    {
+        const unsigned char *q = (const unsigned char *) p;
+        const int c = d / 8;
+
+        for (int i = 0; i < 16; i++)
+        {
+            const int x = std::min(bx * 4 + (i & 3), w - 1);
+            const int y = std::min(by * 4 + (i / 4), h - 1);
+            const unsigned char *s = q + (size_t(y) * w + x) * c;
+
+            switch (c)
+            {
+            case 1:  v[0][i] = v[1][i] = v[2][i] = s[0]; v[3][i] = 255; break;
+            case 2:  v[0][i] = s[0]; v[1][i] = s[1]; v[2][i] = 0;
+                                                     v[3][i] = 255; break;
+            case 3:  v[0][i] = s[2]; v[1][i] = s[1]; v[2][i] = s[0];
+                                                     v[3][i] = 255; break;
+            default: v[0][i] = s[2]; v[1][i] = s[1]; v[2][i] = s[0];
+                                                     v[3][i] = s[3]; break;
+            }
+        }
+    }
+
+    /// Pack an RGB color in [0, 255] to 5:6:5 and unpack it again.
+
+    inline int bc_pack565(const float *c)
+    {
+        const int r = std::min(std::max(int(c[0] * 31 / 255 + 0.5f), 0), 31);
+        const int g = std::min(std::max(int(c[1] * 63 / 255 + 0.5f), 0), 63);
+        const int b = std::min(std::max(int(c[2] * 31 / 255 + 0.5f), 0), 31);
+
+        return (r << 11) | (g << 5) | b;
+    }
+
+    inline void bc_unpack565(int v, int *c)
+    {
+        c[0] = ((v >> 11) & 31) << 3; c[0] |= c[0] >> 5;
+        c[1] = ((v >>  5) & 63) << 2; c[1] |= c[1] >> 6;
+        c[2] = ((v      ) & 31) << 3; c[2] |= c[2] >> 5;
+    }
+
+    /// Quantize endpoints a and b, choose the nearest palette entry for each
+    /// pixel of v, and write the 8-byte color block to out. Return the error.
+
+    inline float bc_fit_color(const float v[4][16], const float *a,
+                              const float *b, unsigned char *out)
+    {
+        int c0 = bc_pack565(a);
+        int c1 = bc_pack565(b);
+
+        if (c0 < c1) std::swap(c0, c1);
+
+        int p[4][3];
+
+        bc_unpack565(c0, p[0]);
+        bc_unpack565(c1, p[1]);
+
+        for (int k = 0; k < 3; k++)
+        {
+            p[2][k] = (2 * p[0][k] + p[1][k]) / 3;
+            p[3][k] = (p[0][k] + 2 * p[1][k]) / 3;
+        }
+
+        unsigned int bits = 0;
+        float        err  = 0;
+
+        for (int i = 0; i < 16; i++)
+        {
+            float best = 1e30f;
+            int   j    = 0;
+
+            for (int e = 0; e < (c0 == c1 ? 1 : 4); e++)
+            {
+                const float dr = v[0][i] - p[e][0];
+                const float dg = v[1][i] - p[e][1];
+                const float db = v[2][i] - p[e][2];
+                const float dd = dr * dr + dg * dg + db * db;
+
+                if (dd < best) { best = dd; j = e; }
+            }
+            bits |= j << (2 * i);
+            err  += best;
+        }
+
+        out[0] = (unsigned char) (c0 & 0xFF);
+        out[1] = (unsigned char) (c0 >> 8);
+        out[2] = (unsigned char) (c1 & 0xFF);
+        out[3] = (unsigned char) (c1 >> 8);
+        out[4] = (unsigned char) (bits       & 0xFF);
+        out[5] = (unsigned char) (bits >>  8 & 0xFF);
+        out[6] = (unsigned char) (bits >> 16 & 0xFF);
+        out[7] = (unsigned char) (bits >> 24 & 0xFF);
+
+        return err;
+    }
+
+    /// Encode the color of block v as an 8-byte BC1 color block. The fast
+    /// mode takes endpoints from the bounding box. The high-quality mode
+    /// takes them from the principal axis and refines them by least squares.
+
+    inline void bc_encode_color(const float v[4][16], unsigned char *out, bool hq)
+    {
+        float m[3] = { 0, 0, 0 }, a[3], b[3];
+
+        for (int k = 0; k < 3; k++)
+        {
+            for (int i = 0; i < 16; i++)
+                m[k] += v[k][i];
+            m[k] /= 16;
+        }
+
+        if (hq)
+        {
+            // Find the principal axis of the covariance by power iteration.
+
+            float C[6] = { 0, 0, 0, 0, 0, 0 };
+
+            for (int i = 0; i < 16; i++)
+            {
+                const float r = v[0][i] - m[0];
+                const float g = v[1][i] - m[1];
+                const float u = v[2][i] - m[2];
+
+                C[0] += r * r; C[1] += r * g; C[2] += r * u;
+                C[3] += g * g; C[4] += g * u; C[5] += u * u;
+            }
+
+            float x[3] = { 1, 1, 1 };
+
+            for (int n = 0; n < 8; n++)
+            {
+                const float y0 = C[0] * x[0] + C[1] * x[1] + C[2] * x[2];
+                const float y1 = C[1] * x[0] + C[3] * x[1] + C[4] * x[2];
+                const float y2 = C[2] * x[0] + C[4] * x[1] + C[5] * x[2];
+                const float l  = std::max(std::max(fabsf(y0), fabsf(y1)), fabsf(y2));
+
+                if (l > 0) { x[0] = y0 / l; x[1] = y1 / l; x[2] = y2 / l; }
+            }
+
+            float t0 = 0, t1 = 0;
+
+            for (int i = 0; i < 16; i++)
+            {
+                const float t = (v[0][i] - m[0]) * x[0]
+                              + (v[1][i] - m[1]) * x[1]
+                              + (v[2][i] - m[2]) * x[2];
+                t0 = std::max(t0, t);
+                t1 = std::min(t1, t);
+            }
+            for (int k = 0; k < 3; k++)
+            {
+                a[k] = m[k] + x[k] * t0;
+                b[k] = m[k] + x[k] * t1;
+            }
+        }
+        else
+        {
+            // Take the bounding box diagonal that follows the correlation of
+            // green and blue with red, and inset it slightly.
+
+            for (int k = 0; k < 3; k++)
+            {
+                float lo = 255, hi = 0, s = 0;
+
+                for (int i = 0; i < 16; i++)
+                {
+                    lo = std::min(lo, v[k][i]);
+                    hi = std::max(hi, v[k][i]);
+                    s += (v[k][i] - m[k]) * (v[0][i] - m[0]);
+                }
+
+                const float e = (hi - lo) / 16;
+
+                a[k] = (s < 0) ? lo + e : hi - e;
+                b[k] = (s < 0) ? hi - e : lo + e;
+            }
+        }
+
+        float err = bc_fit_color(v, a, b, out);
+
+        // Solve for the endpoints that best fit the chosen indices.
+
+        for (int n = 0; hq && n < 2 && err > 0; n++)
+        {
+            static const float wt[4] = { 1.f, 0.f, 2.f / 3.f, 1.f / 3.f };
+
+            const unsigned int bits = out[4] | out[5] << 8 | out[6] << 16
+                                             | unsigned(out[7]) << 24;
+
+            float aa = 0, ab = 0, bb = 0, ax[3] = { 0, 0, 0 }, bx[3] = { 0, 0, 0 };
+
+            for (int i = 0; i < 16; i++)
+            {
+                const float s = wt[(bits >> (2 * i)) & 3];
+                const float t = 1 - s;
+
+                aa += s * s; ab += s * t; bb += t * t;
+
+                for (int k = 0; k < 3; k++)
+                {
+                    ax[k] += s * v[k][i];
+                    bx[k] += t * v[k][i];
+                }
+            }
+
+            const float det = aa * bb - ab * ab;
+
+            if (fabsf(det) < 1e-6f)
+                break;
+
+            for (int k = 0; k < 3; k++)
+            {
+                a[k] = (bb * ax[k] - ab * bx[k]) / det;
+                b[k] = (aa * bx[k] - ab * ax[k]) / det;
+            }
+
+            unsigned char tmp[8];
+
+            const float e = bc_fit_color(v, a, b, tmp);
+
+            if (e < err)
+            {
+                memcpy(out, tmp, 8);
+                err = e;
+            }
+            else break;
+        }
+    }
+
+    /// Return the 8-entry palette of a BC4 block with endpoints a0 and a1.
+
+    inline void bc_palette1(int a0, int a1, int *p)
+    {
+        p[0] = a0;
+        p[1] = a1;
+
+        if (a0 > a1)
+            for (int i = 1; i < 7; i++)
+                p[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+        else
+        {
+            for (int i = 1; i < 5; i++)
+                p[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+            p[6] = 0;
+            p[7] = 255;
+        }
+    }
+
+    /// Fit the single channel v to endpoints a0 and a1, writing an 8-byte
+    /// BC4 block to out. Return the error.
+
+    inline int bc_fit_channel(const float *v, int a0, int a1, unsigned char *out)
+    {
+        int p[8];
+
+        bc_palette1(a0, a1, p);
+
+        unsigned long long bits = 0;
+        int                err  = 0;
+
+        for (int i = 0; i < 16; i++)
+        {
+            const int x = int(v[i] + 0.5f);
+            int best = 1 << 30, j = 0;
+
+            for (int e = 0; e < 8; e++)
+                if ((x - p[e]) * (x - p[e]) < best)
+                {
+                    best = (x - p[e]) * (x - p[e]);
+                    j    = e;
+                }
+
+            bits |= (unsigned long long) j << (3 * i);
+            err  += best;
+        }
+
+        out[0] = (unsigned char) a0;
+        out[1] = (unsigned char) a1;
+
+        for (int k = 0; k < 6; k++)
+            out[k + 2] = (unsigned char) (bits >> (8 * k) & 0xFF);
+
+        return err;
+    }
+
+    /// Encode single channel v as an 8-byte BC4 block. The fast mode uses the
+    /// range of v. The high-quality mode also searches nearby endpoints and
+    /// the six-value mode with explicit 0 and 255.
+
+    inline void bc_encode_channel(const float *v, unsigned char *out, bool hq)
+    {
+        int lo = 255, hi = 0, ilo = 255, ihi = 0;
+
+        for (int i = 0; i < 16; i++)
+        {
+            const int x = int(v[i] + 0.5f);
+
+            lo = std::min(lo, x);
+            hi = std::max(hi, x);
+
+            if (x > 0 && x < 255)
+            {
+                ilo = std::min(ilo, x);
+                ihi = std::max(ihi, x);
+            }
+        }
+
+        if (hi == lo)
+        {
+            bc_fit_channel(v, hi, lo, out);
+            return;
+        }
+
+        int err = bc_fit_channel(v, hi, lo, out);
+
+        if (hq)
+        {
+            unsigned char tmp[8];
+            int e;
+
+            for (int i = -2; i <= 2 && err; i++)
+                for (int j = -2; j <= 2 && err; j++)
+                {
+                    const int a0 = hi + i;
+                    const int a1 = lo + j;
+
+                    if (a0 > a1 && a0 <= 255 && a1 >= 0)
+                        if ((e = bc_fit_channel(v, a0, a1, tmp)) < err)
+                        {
+                            memcpy(out, tmp, 8);
+                            err = e;
+                        }
+                }
+
+            if (ilo <= ihi && (e = bc_fit_channel(v, ilo, ihi, tmp)) < err)
+                memcpy(out, tmp, 8);
+        }
+    }
+
+    /// Compress the w by h image p of depth d to block format f. Block rows
+    /// are encoded in parallel. If hq is true, use the slower high-quality
+    /// encoder. Return a newly-allocated buffer of bc_size bytes, or null
+    /// if f is not a block format or the image is empty.
+
+    inline void *compress_bc(const void *p, int w, int h, int d, int f,
+                             bool hq = false)
+    {
+        if (bc_format(f) == 0 || w < 1 || h < 1)
+            return 0;
+
+        const int bw = (w + 3) / 4;
+        const int bh = (h + 3) / 4;
+        const int bs = bc_block_size(f);
+
+        if (unsigned char *q = (unsigned char *) malloc(bc_size(w, h, f)))
+        {
+            parallel_for(bh, [&](int by)
+            {
+                float v[4][16];
+
+                for (int bx = 0; bx < bw; bx++)
+                {
+                    unsigned char *o = q + (size_t(by) * bw + bx) * bs;
+
+                    bc_load(p, w, h, d, bx, by, v);
+
+                    switch (f)
+                    {
+                    case bc1: bc_encode_color  (v,    o,     hq); break;
+                    case bc3: bc_encode_channel(v[3], o,     hq);
+                              bc_encode_color  (v,    o + 8, hq); break;
+                    case bc4: bc_encode_channel(v[0], o,     hq); break;
+                    case bc5: bc_encode_channel(v[0], o,     hq);
+                              bc_encode_channel(v[1], o + 8, hq); break;
+                    }
+                }
+            });
+            return q;
+        }
+        return 0;
+    }
+
+    /// Decompress block format f data q of a w by h image. Return a newly-
+    /// allocated buffer of depth 32 for BC1 and BC3, 8 for BC4, and 16 for
+    /// BC5, in the channel order of read_tga. Return null on failure or if
+    /// f is not a block format.
+
+    inline void *decompress_bc(const void *q, int w, int h, int f)
+    {
+        if (bc_format(f) == 0 || w < 1 || h < 1)
+            return 0;
+
+        const int c  = (f == bc4) ? 1 : (f == bc5) ? 2 : 4;
+        const int bw = (w + 3) / 4;
+        const int bs = bc_block_size(f);
+
+        const unsigned char *s = (const unsigned char *) q;
+
+        if (unsigned char *p = (unsigned char *) malloc(size_t(w) * h * c))
+        {
+            parallel_for((h + 3) / 4, [&](int by)
+            {
+                for (int bx = 0; bx < bw; bx++)
+                {
+                    const unsigned char *b = s + (size_t(by) * bw + bx) * bs;
+
+                    int px[16][4];
+
+                    for (int i = 0; i < 16; i++)
+                        px[i][0] = px[i][1] = px[i][2] = 0, px[i][3] = 255;
+
+                    // Decode single-channel blocks into the given channel.
+
+                    auto channel = [&](const unsigned char *e, int k)
+                    {
+                        int pal[8];
+                        bc_palette1(e[0], e[1], pal);
+
+                        unsigned long long bits = 0;
+
+                        for (int j = 0; j < 6; j++)
+                            bits |= (unsigned long long) e[j + 2] << (8 * j);
+
+                        for (int i = 0; i < 16; i++)
+                            px[i][k] = pal[(bits >> (3 * i)) & 7];
+                    };
+
+                    // Decode color blocks into red, green, and blue.
+
+                    auto color = [&](const unsigned char *e, bool four)
+                    {
+                        const int c0 = e[0] | e[1] << 8;
+                        const int c1 = e[2] | e[3] << 8;
+
+                        int pal[4][4];
+
+                        bc_unpack565(c0, pal[0]);
+                        bc_unpack565(c1, pal[1]);
+                        pal[0][3] = pal[1][3] = pal[2][3] = 255;
+                        pal[3][3] = 255;
+
+                        for (int k = 0; k < 3; k++)
+                            if (four || c0 > c1)
+                            {
+                                pal[2][k] = (2 * pal[0][k] + pal[1][k]) / 3;
+                                pal[3][k] = (pal[0][k] + 2 * pal[1][k]) / 3;
+                            }
+                            else
+                            {
+                                pal[2][k] = (pal[0][k] + pal[1][k]) / 2;
+                                pal[3][k] = 0;
+                            }
+
+                        if (!four && c0 <= c1) pal[3][3] = 0;
+
+                        const unsigned int bits = e[4] | e[5] << 8 | e[6] << 16
+                                                       | unsigned(e[7]) << 24;
+
+                        for (int i = 0; i < 16; i++)
+                            for (int k = 0; k < (four ? 3 : 4); k++)
+                                px[i][k] = pal[(bits >> (2 * i)) & 3][k];
+                    };
+
+                    switch (f)
+                    {
+                    case bc1: color  (b,     false);               break;
+                    case bc3: channel(b,     3); color(b + 8, true); break;
+                    case bc4: channel(b,     0);                   break;
+                    case bc5: channel(b,     0); channel(b + 8, 1);  break;
+                    }
+
+                    for (int i = 0; i < 16; i++)
+                    {
+                        const int x = bx * 4 + (i & 3);
+                        const int y = by * 4 + (i / 4);
+
+                        if (x < w && y < h)
+                        {
+                            unsigned char *o = p + (size_t(y) * w + x) * c;
+
+                            if (c == 4)
+                            {
+                                o[0] = (unsigned char) px[i][2];
+                                o[1] = (unsigned char) px[i][1];
+                                o[2] = (unsigned char) px[i][0];
+                                o[3] = (unsigned char) px[i][3];
+                            }
+                            else
+                                for (int k = 0; k < c; k++)
+                                    o[k] = (unsigned char) px[i][k];
+                        }
+                    }
+                }
+            });
+            return p;
+        }
+        return 0;
+    }
+
+    /// Upload block format f data q of a w by h image to the given level of
+    /// the bound texture target.
+
+    inline void upload_bc(GLenum target, GLint level, int f, int w, int h,
+                          const void *q, bool srgb = false)
+    {
+        glCompressedTexImage2D(target, level, bc_format(f, srgb), w, h, 0,
+                               GLsizei(bc_size(w, h, f)), q);
+    }
+
+    //--------------------------------------------------------------------------
+
+    #pragma pack(push, 1)
+    struct tex_head
+    {
+        char               magic[4];
+        unsigned int       version;
+        unsigned int       width;
+        unsigned int       height;
+        unsigned int       levels;
+        unsigned int       internal_format;
+        unsigned int       format;
+        unsigned int       type;
+        unsigned long long hash;
+    };
+    struct tex_level
+    {
+        unsigned long long offset;
+        unsigned long long size;
+        unsigned int       width;
+        unsigned int       height;
+    };
+    #pragma pack(pop)
+
+    /// A texture container file mapped into memory. Level payloads are ready
+    /// for direct upload from the mapping.
+
+    struct tex_file
+    {
+        const tex_head      *head;
+        const tex_level     *level;
+        const unsigned char *data;
+        size_t               size;
+    };
+
+    /// Write a texture container holding the w by h image p of depth d. If f
+    /// is a block format, compress each level with it. If m is true, store a
+    /// full mipmap chain filtered as sRGB when s is true. Payloads are 4 KB
+    /// aligned and hashed. Return 0 on success and -1 on failure.
+
+    inline int write_tex(const char *filename, const void *p, int w, int h,
+                         int d, int f = 0, bool m = true, bool s = false)
+    {
+        int   n = 1;
+        void *q = m ? make_mipmap(p, w, h, d, n, mipmap_box, s) : 0;
+
+        const unsigned char *src = (const unsigned char *) (q ? q : p);
+
+        std::vector<void *>    data(n, (void *) 0);
+        std::vector<tex_level> level(n);
+
+        tex_head head;
+
+        memset(&head,     0, sizeof (tex_head));
+        memset(&level[0], 0, sizeof (tex_level) * n);
+        memcpy(head.magic, "GLTX", 4);
+
+        head.version = 1;
+        head.width   = w;
+        head.height  = h;
+        head.levels  = n;
+        head.hash    = hash(0, 0);
+
+        if (f)
+        {
+            head.internal_format = bc_format(f, s);
+        }
+        else
+        {
+            static const GLenum lin[4] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+            static const GLenum rgb[4] = { GL_R8, GL_RG8, GL_SRGB8,
+                                                          GL_SRGB8_ALPHA8 };
+            const GLenum *i = s ? rgb : lin;
+
+            head.internal_format = i[d / 8 - 1];
+            head.format          = pixel_format(d);
+            head.type            = GL_UNSIGNED_BYTE;
+        }
+
+        // Lay out the levels and compress them if requested.
+
+        unsigned long long o = (sizeof (tex_head) + n * sizeof (tex_level)
+                                + 4095) & ~4095ULL;
+        int err = 0;
+
+        for (int l = 0; l < n; l++)
+        {
+            const int lw = mipmap_dim(w, l);
+            const int lh = mipmap_dim(h, l);
+
+            const unsigned char *b = src + mipmap_offset(w, h, d, l);
+
+            level[l].width  = lw;
+            level[l].height = lh;
+            level[l].offset = o;
+
+            if (f)
+            {
+                if ((data[l] = compress_bc(b, lw, lh, d, f, true)) == 0)
+                    err = -1;
+                level[l].size = bc_size(lw, lh, f);
+            }
+            else
+            {
+                data[l]       = (void *) b;
+                level[l].size = size_t(lw) * lh * (d / 8);
+            }
+
+            if (data[l])
+                head.hash = hash(data[l], size_t(level[l].size), head.hash);
+
+            o = (o + level[l].size + 4095) & ~4095ULL;
+        }
+
+        // Write the header, level table, and padded payloads.
+
+        if (err == 0)
+        {
+            err = -1;
+
+            if (FILE *stream = fopen(filename, "wb"))
+            {
+                if (fwrite(&head,     sizeof (tex_head),  1, stream) == 1 &&
+                    fwrite(&level[0], sizeof (tex_level), n, stream) == size_t(n))
+                {
+                    err = 0;
+
+                    for (int l = 0; l < n && err == 0; l++)
+                        if (fseek(stream, long(level[l].offset), SEEK_SET) ||
+                            fwrite(data[l], 1, size_t(level[l].size),
+                                   stream) != level[l].size)
+                            err = -1;
+
+                    // Extend the file to cover the padding of the last level.
+
+                    if (err == 0 && fseek(stream, long(o) - 1, SEEK_SET) == 0)
+                        err = (fputc(0, stream) == EOF) ? -1 : 0;
+                }
+                fclose(stream);
+            }
+        }
+
+        if (f)
+            for (int l = 0; l < n; l++)
+                free(data[l]);
+
+        free(q);
+        return err;
+    }
+
+    /// Release a mapped texture container.
+
+    inline void unmap_tex(tex_file& t)
+    {
+        if (t.data)
+        {
+#ifndef _WIN32
+            munmap((void *) t.data, t.size);
+#else
+            free((void *) t.data);
+#endif
+        }
+        memset(&t, 0, sizeof (tex_file));
+    }
+
+    /// Return the payload size of a w by h level of a texture container with
+    /// the given header, or 0 if its format is not one write_tex produces.
+
+    inline size_t tex_size(const tex_head& head, int w, int h)
+    {
+        if (head.format == 0)
+        {
+            for (int f = bc1; f <= bc5; f++)
+                if (bc_format(f) && (bc_format(f)       == head.internal_format ||
+                                     bc_format(f, true) == head.internal_format))
+                    return bc_size(w, h, f);
+        }
+        else if (head.type == GL_UNSIGNED_BYTE)
+        {
+            for (int d = 8; d <= 32; d += 8)
+                if (pixel_format(d) == head.format)
+                    return size_t(w) * size_t(h) * (d / 8);
+        }
+        return 0;
+    }
+
+    /// Map the named texture container into memory. Return 0 on success and
+    /// -1 on failure or if the file is malformed. Every level is checked to
+    /// lie within the file and to have the size and dimensions implied by
+    /// the header, so that it may be hashed and uploaded safely.
+
+    inline int map_tex(const char *filename, tex_file& t)
+    {
+        memset(&t, 0, sizeof (tex_file));
+
+#ifndef _WIN32
+        int fd;
+
+        if ((fd = open(filename, O_RDONLY)) >= 0)
+        {
+            struct stat st;
+
+            if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof (tex_head))
+            {
+                void *p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+                if (p != MAP_FAILED)
+                {
+                    madvise(p, st.st_size, MADV_WILLNEED);
+                    t.data = (const unsigned char *) p;
+                    t.size = size_t(st.st_size);
+                }
+            }
+            close(fd);
+        }
+#else
+        if (FILE *stream = fopen(filename, "rb"))
+        {
+            if (fseek(stream, 0, SEEK_END) == 0)
+            {
+                const size_t n = size_t(ftell(stream));
+
+                if (fseek(stream, 0, SEEK_SET) == 0 && n >= sizeof (tex_head))
+                    if (void *p = malloc(n))
+                    {
+                        if (fread(p, 1, n, stream) == n)
+                        {
+                            t.data = (const unsigned char *) p;
+                            t.size = n;
+                        }
+                        else free(p);
+                    }
+            }
+            fclose(stream);
+        }
+#endif
+        if (t.data)
+        {
+            t.head  = (const tex_head  *)  t.data;
+            t.level = (const tex_level *) (t.data + sizeof (tex_head));
+
+            const tex_head& head = *t.head;
+
+            bool ok = memcmp(head.magic, "GLTX", 4) == 0
+                   && head.version == 1
+                   && head.width  >= 1 && head.width  <= 65536
+                   && head.height >= 1 && head.height <= 65536
+                   && head.levels >= 1 && head.levels <= unsigned(
+                          mipmap_levels(int(head.width), int(head.height)))
+                   && sizeof (tex_head) + head.levels
+                    * sizeof (tex_level) <= t.size;
+
+            for (unsigned int l = 0; ok && l < head.levels; l++)
+            {
+                const tex_level& v = t.level[l];
+
+                ok = v.width  == unsigned(mipmap_dim(int(head.width),  int(l)))
+                  && v.height == unsigned(mipmap_dim(int(head.height), int(l)))
+                  && v.size   == tex_size(head, int(v.width), int(v.height))
+                  && v.size   >  0
+                  && v.size   <= t.size
+                  && v.offset <= t.size - v.size;
+            }
+
+            if (ok)
+                return 0;
+        }
+        unmap_tex(t);
+        return -1;
+    }
+
+    /// Recompute the content hash of a mapped texture container and return
+    /// true if it matches the stored hash.
+
+    inline bool verify_tex(const tex_file& t)
+    {
+        unsigned long long h = hash(0, 0);
+
+        for (unsigned int l = 0; l < t.head->levels; l++)
+            h = hash(t.data + t.level[l].offset, size_t(t.level[l].size), h);
+
+        return h == t.head->hash;
+    }
+
+    /// Upload all levels of a mapped texture container to the bound texture
+    /// target directly from the mapping. Unpack alignment is restored
+    /// afterward.
+
+    inline void upload_tex(GLenum target, const tex_file& t)
+    {
+        GLint a = 4;
+
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &a);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        for (unsigned int l = 0; l < t.head->levels; l++)
+        {
+            const tex_level& v = t.level[l];
+
+            if (t.head->format)
+                glTexImage2D(target, l, t.head->internal_format,
+                             v.width, v.height, 0, t.head->format,
+                             t.head->type, t.data + v.offset);
+            else
+                glCompressedTexImage2D(target, l, t.head->internal_format,
+                                       v.width, v.height, 0, GLsizei(v.size),
+                                       t.data + v.offset);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, a);
+        glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, t.head->levels - 1);
+    }
+
+    //--------------------------------------------------------------------------
+
+    /// A decoded image shared through an image_cache. The pixels are freed
+    /// when the last handle is released.
+
+    struct cached_image
+    {
+        cached_image() : p(0), w(0), h(0), d(0) { }
+       ~cached_image() { free(p); }
+
+        void *p;
+        int   w;
+        int   h;
+        int   d;
+    };
+
+    /// A thread-safe cache of decoded Targa images keyed by path and
+    /// modification time. Images are shared through reference-counted
+    /// handles and evicted in least-recently-used order once the cache holds
+    /// more than its byte budget, or as soon as a newer version of the same
+    /// file is loaded. Concurrent requests for an image that is still loading
+    /// wait for that one load rather than decoding it again.
+
+    class image_cache
+    {
+    public:
+
+        typedef std::shared_ptr<const cached_image> handle;
+
+        /// Create an empty cache holding at most b bytes of pixels.
+
+        image_cache(size_t b) :
+            budget(b), bytes(0), hits(0), misses(0), evictions(0)
+        {
+        }
+
+        /// Return the named image, loading it if necessary. Return a null
+        /// handle if it cannot be loaded. Gray is passed to read_tga. If the
+        /// load throws, so does every request waiting for it.
+
+        handle get(const char *filename, bool gray = false)
+        {
+            const std::string name = std::string(filename)
+                                   + (gray ? "?gray@" : "@");
+
+            std::string key = name;
+            struct stat st;
+
+            if (stat(filename, &st) == 0)
+                key += std::to_string((long long) st.st_mtime);
+
+            std::promise<handle> promise;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                auto i = entries.find(key);
+
+                if (i != entries.end())
+                {
+                    order.splice(order.begin(), order, i->second.second);
+                    hits++;
+                    return i->second.first;
+                }
+
+                auto j = loading.find(key);
+
+                if (j != loading.end())
+                {
+                    std::shared_future<handle> f = j->second;
+                    hits++;
+                    lock.unlock();
+                    return f.get();
+                }
+
+                loading[key] = promise.get_future().share();
+                misses++;
+            }
+
+            // Decode outside the lock so that other requests may proceed.
+            // Release those waiting on this load however it ends.
+
+            handle r;
+
+            try
+            {
+                std::shared_ptr<cached_image> m(new cached_image);
+
+                m->p = read_tga(filename, m->w, m->h, m->d, gray);
+
+                if (m->p)
+                    r = m;
+            }
+            catch (...)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    loading.erase(key);
+                }
+                promise.set_exception(std::current_exception());
+                throw;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                if (r)
+                {
+                    // Evict the image of any other modification time.
+
+                    auto k = latest.find(name);
+
+                    if (k != latest.end() && k->second != key)
+                        evict(k->second);
+
+                    latest[name] = key;
+
+                    order.push_front(key);
+                    entries[key] = std::make_pair(r, order.begin());
+                    bytes += size(r);
+                    trim();
+                }
+                loading.erase(key);
+            }
+            promise.set_value(r);
+            return r;
+        }
+
+        /// Set the byte budget, evicting as needed.
+
+        void set_budget(size_t b)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            budget = b;
+            trim();
+        }
+
+        /// Drop all cached images. Outstanding handles remain valid.
+
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            entries.clear();
+            latest.clear();
+            order.clear();
+            bytes = 0;
+        }
+
+        size_t get_bytes()     const { return bytes;     }
+        size_t get_hits()      const { return hits;      }
+        size_t get_misses()    const { return misses;    }
+        size_t get_evictions() const { return evictions; }
+
+    private:
+
+        static size_t size(const handle& m)
+        {
+            return size_t(m->w) * m->h * (m->d / 8);
+        }
+
+        /// Evict least-recently-used images until within budget, always
+        /// keeping the most recent.
+
+        void trim()
+        {
+            while (bytes > budget && order.size() > 1)
+                evict(order.back());
+        }
+
+        /// Drop the image with the given key, if cached. The key is copied,
+        /// as it may be one of those erased.
+
+        void evict(const std::string key)
+        {
+            auto i = entries.find(key);
+
+            if (i != entries.end())
+            {
+                auto k = latest.find(key.substr(0, key.rfind('@') + 1));
+
+                if (k != latest.end() && k->second == key)
+                    latest.erase(k);
+
+                bytes -= size(i->second.first);
+                order.erase(i->second.second);
+                entries.erase(i);
+                evictions++;
+            }
+        }
+
+        typedef std::list<std::string> lru;
+
+        std::unordered_map<std::string, std::pair<handle, lru::iterator> > entries;
+        std::unordered_map<std::string, std::shared_future<handle> >       loading;
+        std::unordered_map<std::string, std::string>                       latest;
+
+        lru        order;
+        std::mutex mutex;
+
+        size_t budget;
+        std::atomic<size_t> bytes;
+        std::atomic<size_t> hits;
+        std::atomic<size_t> misses;
+        std::atomic<size_t> evictions;
+    };
+
+    //--------------------------------------------------------------------------
+}
+
+#endif
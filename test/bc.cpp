@@ -0,0 +1,117 @@
+// Check that each block format round-trips a test image through compress_bc
+// and decompress_bc within known error bounds, in both the fast and the
+// high-quality modes, and that unknown formats are rejected. No GL context
+// is needed.
+//
+//     c++ -std=c++11 -pthread -I.. bc.cpp -o bc
+
+#include <cstdio>
+#include <cmath>
+#include <vector>
+
+#include "GLTexture.hpp"
+
+//------------------------------------------------------------------------------
+
+static const int w = 37;
+static const int h = 29;
+
+/// Return channel k of the test image at x, y: smooth gradients crossed by
+/// a hard edge, as in typical texture content.
+
+static int source(int x, int y, int k)
+{
+    const int g[4] = { x * 255 / (w - 1), y * 255 / (h - 1),
+                       (x + y) * 255 / (w + h - 2), 255 - x * 255 / (w - 1) };
+
+    return (x + y < 30) ? g[k] : 255 - g[k] / 2;
+}
+
+/// Compress and decompress the test image in format f with c channels in
+/// and e channels out. Check the root mean square and largest channel
+/// errors against the given bounds.
+
+static int round_trip(const char *name, int f, bool hq, int c, int e,
+                      double rms, int max)
+{
+    std::vector<unsigned char> p(size_t(w) * h * c);
+
+    // Input is in the channel order of read_tga, BGRA for 32 bits.
+
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+            for (int k = 0; k < c; k++)
+                p[(size_t(y) * w + x) * c + k] =
+                    (unsigned char) source(x, y, (c == 4 && k < 3) ? 2 - k : k);
+
+    if (c == 4 && f == gl::bc1)
+        for (size_t i = 3; i < p.size(); i += 4)
+            p[i] = 255;
+
+    void *q = gl::compress_bc(&p[0], w, h, c * 8, f, hq);
+    void *r = q ? gl::decompress_bc(q, w, h, f) : 0;
+
+    double sum = 0;
+    int    big = 0;
+
+    if (r)
+    {
+        const unsigned char *s = (const unsigned char *) r;
+
+        for (size_t i = 0; i < size_t(w) * h; i++)
+            for (int k = 0; k < e; k++)
+            {
+                const int d = std::abs(int(s[i * e + k]) - int(p[i * c + k]));
+
+                sum += double(d) * d;
+                big  = std::max(big, d);
+            }
+    }
+
+    const double err = sqrt(sum / (double(w) * h * e));
+
+    free(r);
+    free(q);
+
+    if (r == 0 || err > rms || big > max)
+    {
+        fprintf(stderr, "%s%s: rms %.2f max %d\n", name, hq ? " hq" : "",
+                err, big);
+        return 1;
+    }
+    return 0;
+}
+
+int main()
+{
+    int errors = 0;
+
+    // Blocks spanning the edge bound the largest error. The high-quality
+    // encoder must lower the mean error.
+
+    errors += round_trip("bc1", gl::bc1, false, 4, 4, 6.0, 40);
+    errors += round_trip("bc3", gl::bc3, false, 4, 4, 6.0, 40);
+    errors += round_trip("bc4", gl::bc4, false, 1, 1, 3.0, 24);
+    errors += round_trip("bc5", gl::bc5, false, 2, 2, 3.0, 24);
+    errors += round_trip("bc1", gl::bc1, true,  4, 4, 4.6, 40);
+    errors += round_trip("bc3", gl::bc3, true,  4, 4, 4.6, 40);
+    errors += round_trip("bc4", gl::bc4, true,  1, 1, 2.2, 24);
+    errors += round_trip("bc5", gl::bc5, true,  2, 2, 2.2, 24);
+
+    // Unknown formats and empty images are rejected.
+
+    unsigned char p[64] = { 0 };
+
+    if (gl::compress_bc  (p, 4, 4, 32, 2) || gl::compress_bc  (p, 4, 4, 32, 0)
+     || gl::decompress_bc(p, 4, 4,     2) || gl::decompress_bc(p, 4, 4,     6)
+     || gl::compress_bc  (p, 0, 4, 32, gl::bc1))
+    {
+        fprintf(stderr, "unknown format: accepted\n");
+        errors++;
+    }
+
+    if (errors == 0)
+        printf("bc: ok\n");
+
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,179 @@
+// Check the half float conversions against known bit patterns, the bulk
+// conversions against the scalar ones, and tone-mapped output of every
+// channel count. No GL context is needed.
+//
+//     c++ -std=c++11 -pthread -I.. half.cpp -o half
+
+#include <cstdio>
+#include <cmath>
+#include <vector>
+
+#include "GLImage.hpp"
+
+//------------------------------------------------------------------------------
+
+static const char *filename = "test_half.tga";
+
+struct pattern
+{
+    float          f;
+    unsigned short h;
+};
+
+/// Values exactly representable as half floats, and their bit patterns.
+
+static const pattern exact[] =
+{
+    {  0.0f,                    0x0000 },
+    { -0.0f,                    0x8000 },
+    {  1.0f,                    0x3C00 },
+    { -2.0f,                    0xC000 },
+    {  0.5f,                    0x3800 },
+    {  0.333251953125f,         0x3555 },
+    {  65504.0f,                0x7BFF },  // largest
+    {  6.103515625e-05f,        0x0400 },  // smallest normal
+    {  6.097555160522461e-05f,  0x03FF },  // largest subnormal
+    {  5.960464477539063e-08f,  0x0001 },  // smallest subnormal
+    {  INFINITY,                0x7C00 },
+    { -INFINITY,                0xFC00 },
+};
+
+/// Values that must round, and the patterns they round to.
+
+static const pattern rounded[] =
+{
+    {  65520.0f,                0x7C00 },  // overflows to infinity
+    {  1e10f,                   0x7C00 },
+    {  1.00048828125f,          0x3C00 },  // halfway, down to even
+    {  1.00146484375f,          0x3C02 },  // halfway, up to even
+    {  2.98023223876953125e-08f,0x0000 },  // half the smallest subnormal
+    {  8.940696716308594e-08f,  0x0002 },  // one and a half of it
+    {  1e-10f,                  0x0000 },  // underflows to zero
+};
+
+static int patterns()
+{
+    int errors = 0;
+
+    for (size_t i = 0; i < sizeof (exact) / sizeof (pattern); i++)
+    {
+        const unsigned short h = gl::to_half(exact[i].f);
+        const float          f = gl::from_half(exact[i].h);
+
+        if (h != exact[i].h || memcmp(&f, &exact[i].f, sizeof (f)))
+        {
+            fprintf(stderr, "exact %g: %04X %g\n", exact[i].f, h, f);
+            errors++;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof (rounded) / sizeof (pattern); i++)
+    {
+        const unsigned short h = gl::to_half(rounded[i].f);
+
+        if (h != rounded[i].h)
+        {
+            fprintf(stderr, "rounded %g: %04X\n", rounded[i].f, h);
+            errors++;
+        }
+    }
+
+    if (!std::isnan(gl::from_half(0x7E00)) || (gl::to_half(NAN) & 0x7FFF) <= 0x7C00)
+    {
+        fprintf(stderr, "nan\n");
+        errors++;
+    }
+    return errors;
+}
+
+/// Every half other than NaN survives a round trip through float, and the
+/// bulk conversions agree with the scalar ones.
+
+static int round_trip()
+{
+    std::vector<unsigned short> h(65536), k(65536);
+    std::vector<float>          f(65536);
+
+    for (int i = 0; i < 65536; i++)
+        h[i] = (unsigned short) i;
+
+    gl::half_to_float(&f[0], &h[0], h.size());
+    gl::float_to_half(&k[0], &f[0], f.size());
+
+    int errors = 0;
+
+    for (int i = 0; i < 65536; i++)
+    {
+        const bool nan = (i & 0x7C00) == 0x7C00 && (i & 0x3FF);
+
+        const float g = gl::from_half(h[i]);
+
+        // F16C quiets signaling NaNs, so NaNs need only remain NaNs.
+
+        if (nan)
+        {
+            if (!std::isnan(f[i]) || !std::isnan(g))
+                errors++;
+        }
+        else if (k[i] != h[i] || gl::to_half(f[i]) != h[i]
+                              || memcmp(&g, &f[i], sizeof (g)))
+            errors++;
+    }
+
+    if (errors)
+        fprintf(stderr, "round trip: %d errors\n", errors);
+
+    return errors;
+}
+
+/// Tone-map a single pixel with c channels and check the depth and the
+/// bytes written, or expect failure if d is 0.
+
+static int tonemap(int c, int d, const unsigned char *want)
+{
+    const float p[5] = { 1.f, 3.f, 0.25f, 0.5f, 0.5f };
+
+    int w = 0, h = 0, e = 0, errors = 0;
+
+    if (gl::write_tonemapped_tga(filename, 1, 1, c, p) == 0)
+    {
+        unsigned char *q = (unsigned char *) gl::read_tga(filename, w, h, e, true);
+
+        if (d == 0 || q == 0 || e != d || memcmp(q, want, d / 8))
+            errors++;
+
+        free(q);
+    }
+    else if (d)
+        errors++;
+
+    if (errors)
+        fprintf(stderr, "tonemap %d channels: failed\n", c);
+
+    return errors;
+}
+
+int main()
+{
+    int errors = patterns() + round_trip();
+
+    // 1 / (1 + 1) is sRGB 188, 3 / (1 + 3) is 225, and 0.2 is 124, in BGR.
+
+    const unsigned char gray [1] = { 188 };
+    const unsigned char rg   [3] = {   0, 225, 188 };
+    const unsigned char rgb  [3] = { 124, 225, 188 };
+
+    errors += tonemap(1,  8, gray);
+    errors += tonemap(2, 24, rg);
+    errors += tonemap(3, 24, rgb);
+    errors += tonemap(4, 24, rgb);
+    errors += tonemap(0,  0, 0);
+    errors += tonemap(5,  0, 0);
+
+    remove(filename);
+
+    if (errors == 0)
+        printf("half: ok\n");
+
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,106 @@
+// Check the distance transform against brute force, and the signed distance
+// field of a disk against its analytic distance. No GL context is needed.
+//
+//     c++ -std=c++11 -pthread -I.. sdf.cpp -o sdf
+
+#include <cstdio>
+#include <cmath>
+#include <vector>
+
+#include "GLImage.hpp"
+
+//------------------------------------------------------------------------------
+
+/// Transform a field of scattered features and compare every squared
+/// distance with that of the nearest feature found by brute force.
+
+static int transform()
+{
+    const int w = 23;
+    const int h = 17;
+
+    std::vector<float> f(w * h);
+
+    for (int i = 0; i < w * h; i++)
+        f[i] = ((i * 2654435761u) >> 24) < 8 ? 0.f : 1e20f;
+
+    std::vector<float> g = f;
+
+    gl::distance_2d(&g[0], w, h);
+
+    int errors = 0;
+
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+        {
+            float best = 1e20f;
+
+            for (int j = 0; j < w * h; j++)
+                if (f[j] == 0)
+                {
+                    const int dx = x - j % w;
+                    const int dy = y - j / w;
+                    best = std::min(best, float(dx * dx + dy * dy));
+                }
+
+            if (g[y * w + x] != best)
+                errors++;
+        }
+
+    if (errors)
+        fprintf(stderr, "transform: %d errors\n", errors);
+
+    return errors;
+}
+
+/// Compute the field of a disk of radius r at full and half size and check
+/// each output against the signed distance to the circle, within a bound.
+
+static int disk(int factor, float bound)
+{
+    const int   n = 64;
+    const int   m = n / factor;
+    const float c = n / 2.f;
+    const float r = 20.f;
+    const float s = 8.f;
+
+    std::vector<unsigned char> p(n * n), q(m * m);
+
+    for (int y = 0; y < n; y++)
+        for (int x = 0; x < n; x++)
+            p[y * n + x] = (std::hypot(x + 0.5f - c, y + 0.5f - c) < r) ? 255 : 0;
+
+    gl::make_sdf(&p[0], n, n, 8, &q[0], m, m, s);
+
+    float worst = 0;
+
+    for (int y = 0; y < m; y++)
+        for (int x = 0; x < m; x++)
+        {
+            const float e = r - std::hypot((x + 0.5f) * factor - c,
+                                           (y + 0.5f) * factor - c);
+            const float v = 255.f * std::min(std::max(0.5f + e / (2 * s), 0.f), 1.f);
+
+            worst = std::max(worst, std::fabs(q[y * m + x] - v));
+        }
+
+    if (worst > bound)
+    {
+        fprintf(stderr, "disk 1/%d: error %.1f\n", factor, worst);
+        return 1;
+    }
+    return 0;
+}
+
+int main()
+{
+    // One source pixel of distance is 16 levels at a spread of 8, and a
+    // mask sampled at pixel centers is within half a pixel of the circle.
+
+    int errors = transform() + disk(1, 10.f) + disk(2, 10.f);
+
+    if (errors == 0)
+        printf("sdf: ok\n");
+
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,160 @@
+// Check that texture containers written by write_tex map and verify, and
+// that malformed ones are rejected by map_tex. No GL context is needed.
+//
+//     c++ -std=c++11 -pthread -I.. tex.cpp -o tex
+
+#include <cstdio>
+#include <vector>
+#include <functional>
+
+#include "GLTexture.hpp"
+
+//------------------------------------------------------------------------------
+
+typedef std::vector<unsigned char> bytes;
+
+static const char *filename = "test_tex.gltx";
+
+static bytes load()
+{
+    bytes b;
+
+    if (FILE *stream = fopen(filename, "rb"))
+    {
+        int c;
+        while ((c = fgetc(stream)) != EOF)
+            b.push_back((unsigned char) c);
+        fclose(stream);
+    }
+    return b;
+}
+
+static void store(const bytes& b)
+{
+    if (FILE *stream = fopen(filename, "wb"))
+    {
+        fwrite(&b[0], 1, b.size(), stream);
+        fclose(stream);
+    }
+}
+
+/// Apply the given change to the header and level table of a copy of the
+/// container b, write it, and check that map_tex rejects it.
+
+static int reject(const char *name, const bytes& b,
+                  std::function<void(gl::tex_head&, gl::tex_level *)> change,
+                  size_t size = 0)
+{
+    bytes c(b.begin(), b.begin() + (size ? size : b.size()));
+
+    gl::tex_head  head;
+    gl::tex_level level[16];
+
+    memcpy(&head,  &c[0], sizeof (head));
+    memcpy(level,  &c[sizeof (head)], sizeof (level));
+    change(head, level);
+    memcpy(&c[0], &head, sizeof (head));
+    memcpy(&c[sizeof (head)], level, sizeof (level));
+
+    store(c);
+
+    gl::tex_file t;
+
+    if (gl::map_tex(filename, t) == 0)
+    {
+        fprintf(stderr, "%s: accepted\n", name);
+        gl::unmap_tex(t);
+        return 1;
+    }
+    return 0;
+}
+
+/// Write a 16 by 16 container with a full mipmap chain in format f, check
+/// that it maps and verifies, and that corruptions of it are rejected.
+
+static int exercise(const char *name, int f)
+{
+    unsigned char p[16 * 16 * 4];
+
+    for (int i = 0; i < int(sizeof (p)); i++)
+        p[i] = (unsigned char) (i * 7);
+
+    if (gl::write_tex(filename, p, 16, 16, 32, f))
+    {
+        fprintf(stderr, "%s: write failed\n", name);
+        return 1;
+    }
+
+    const bytes b = load();
+
+    int errors = 0;
+
+    gl::tex_file t;
+
+    if (gl::map_tex(filename, t) == 0)
+    {
+        if (t.head->levels != 5 || !gl::verify_tex(t))
+        {
+            fprintf(stderr, "%s: verify failed\n", name);
+            errors++;
+        }
+        gl::unmap_tex(t);
+    }
+    else
+    {
+        fprintf(stderr, "%s: map failed\n", name);
+        return 1;
+    }
+
+    typedef gl::tex_head  H;
+    typedef gl::tex_level L;
+
+    errors += reject("magic",   b, [](H& h, L *) { h.magic[0] = 'X';    });
+    errors += reject("version", b, [](H& h, L *) { h.version  = 2;      });
+    errors += reject("levels",  b, [](H& h, L *) { h.levels   = 6;      });
+    errors += reject("width",   b, [](H& h, L *) { h.width    = 0;      });
+    errors += reject("format",  b, [](H& h, L *) { h.format   = 0x1234;
+                                                   h.internal_format = 0x1234; });
+    errors += reject("level width",  b, [](H&, L *l) { l[1].width = 16;  });
+    errors += reject("level size",   b, [](H&, L *l) { l[0].size -= 1;   });
+    errors += reject("level offset", b, [](H&, L *l) { l[4].offset += 1 << 20; });
+    errors += reject("level wrap",   b, [](H&, L *l) {
+        l[0].size = ~0ULL - l[0].offset + 2;
+    });
+    errors += reject("truncated",    b, [](H&, L *) { }, b.size() / 2);
+
+    // A damaged payload maps but fails verification.
+
+    bytes c = b;
+    c[c.size() - 4096] ^= 1;
+    store(c);
+
+    if (gl::map_tex(filename, t) == 0)
+    {
+        if (gl::verify_tex(t))
+        {
+            fprintf(stderr, "%s: damaged payload verified\n", name);
+            errors++;
+        }
+        gl::unmap_tex(t);
+    }
+
+    if (errors)
+        fprintf(stderr, "%s: %d errors\n", name, errors);
+
+    return errors;
+}
+
+int main()
+{
+    int errors = exercise("rgba", 0)
+               + exercise("bc1",  gl::bc1)
+               + exercise("bc3",  gl::bc3);
+
+    remove(filename);
+
+    if (errors == 0)
+        printf("tex: ok\n");
+
+    return errors ? 1 : 0;
+}
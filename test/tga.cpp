@@ -0,0 +1,134 @@
+// Check the Targa decoder on grayscale, run-length encoded, and color-mapped
+// images, and its rejection of malformed headers. No GL context is needed.
+//
+//     c++ -std=c++11 -I.. tga.cpp -o tga
+
+#include <cstdio>
+#include <vector>
+
+#include "GLFundamentals.hpp"
+
+//------------------------------------------------------------------------------
+
+typedef std::vector<unsigned char> bytes;
+
+static const char *filename = "test_tga.tga";
+
+/// Write a file with the given header fields, color map, and pixel data.
+
+static void put(int type, int w, int h, int depth, const bytes& pixels,
+                int map_size = 0, const bytes& map = bytes(), int map_offset = 0)
+{
+    gl::tga_head head;
+
+    memset(&head, 0, sizeof (head));
+
+    head.image_type       = (unsigned char)  type;
+    head.image_width      = (unsigned short) w;
+    head.image_height     = (unsigned short) h;
+    head.image_depth      = (unsigned char)  depth;
+    head.color_map_type   = map_size ? 1 : 0;
+    head.color_map_size   = (unsigned char)  map_size;
+    head.color_map_offset = (unsigned short) map_offset;
+    head.color_map_length = (unsigned short) (map_size ? map.size()
+                                                / ((map_size + 7) / 8) : 0);
+
+    if (FILE *stream = fopen(filename, "wb"))
+    {
+        fwrite(&head, sizeof (head), 1, stream);
+        if (!map.empty())    fwrite(&map[0],    1, map.size(),    stream);
+        if (!pixels.empty()) fwrite(&pixels[0], 1, pixels.size(), stream);
+        fclose(stream);
+    }
+}
+
+/// Read the file and compare it with the expected depth and pixels, or
+/// expect failure if d is 0.
+
+static int check(const char *name, int d, const bytes& want, bool gray = false)
+{
+    int w = 0, h = 0, e = 0;
+
+    unsigned char *p = (unsigned char *) gl::read_tga(filename, w, h, e, gray);
+
+    bool ok = d ? (p && e == d && memcmp(p, &want[0], want.size()) == 0)
+                : (p == 0);
+
+    if (!ok)
+        fprintf(stderr, "%s: failed\n", name);
+
+    free(p);
+    return ok ? 0 : 1;
+}
+
+int main()
+{
+    int errors = 0;
+
+    // Grayscale, kept as 8 bits or expanded to 24.
+    {
+        const bytes pix = { 0, 64, 128, 255 };
+
+        put(3, 2, 2, 8, pix);
+
+        errors += check("gray as gray", 8, pix, true);
+        errors += check("gray as color", 24, { 0, 0, 0, 64, 64, 64,
+                                            128, 128, 128, 255, 255, 255 });
+    }
+
+    // Run-length encoded true color, with a run crossing a row boundary.
+    {
+        const bytes pix = { 0x82, 1, 2, 3,         // run of 3
+                            0x00, 4, 5, 6 };       // 1 literal
+
+        put(10, 2, 2, 24, pix);
+
+        errors += check("rle color", 24, { 1, 2, 3, 1, 2, 3,
+                                           1, 2, 3, 4, 5, 6 });
+    }
+
+    // Color-mapped with 8-bit indices, a 24-bit map, and a map offset.
+    {
+        const bytes map = { 10, 20, 30, 40, 50, 60, 70, 80, 90 };
+        const bytes pix = { 2, 4, 3, 2 };
+
+        put(1, 2, 2, 8, pix, 24, map, 2);
+
+        errors += check("color map", 24, { 10, 20, 30, 70, 80, 90,
+                                           40, 50, 60, 10, 20, 30 });
+    }
+
+    // Run-length encoded color-mapped, with a 16-bit 5-5-5 map.
+    {
+        const bytes map = { 0x1F, 0x00,            // blue
+                            0x00, 0x7C };          // red
+        const bytes pix = { 0x83, 1 };             // run of 4
+
+        put(9, 2, 2, 8, pix, 16, map);
+
+        errors += check("rle color map", 24, { 0, 0, 255, 0, 0, 255,
+                                               0, 0, 255, 0, 0, 255 });
+    }
+
+    // Malformed headers are rejected before any pixel is read.
+    {
+        const bytes map(64, 0);
+        const bytes pix(4, 0);
+
+        put(1, 2, 2, 8, pix, 255, map);
+        errors += check("bad color map size", 0, bytes());
+
+        put(2, 2, 2, 12, pix);
+        errors += check("bad true-color depth", 0, bytes());
+
+        put(2, 2, 2, 24, pix);
+        errors += check("truncated", 0, bytes());
+    }
+
+    remove(filename);
+
+    if (errors == 0)
+        printf("tga: ok\n");
+
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,93 @@
+// Check the member offsets written by gl::uniform_packer against the std140
+// and std430 rules. No GL context is needed.
+//
+//     c++ -std=c++11 -I.. uniform_packer.cpp -o uniform_packer
+//
+// The block under test is
+//
+//     float a; vec3 b; vec2 c; mat3 m; float d; float f[3]; vec3 v[2]; float e;
+
+#include <cstdio>
+
+#include "GLShader.hpp"
+
+//------------------------------------------------------------------------------
+
+struct member
+{
+    const char *name;
+    size_t      offset;
+    float       value;
+};
+
+static void pack(gl::uniform_packer& p)
+{
+    const float    f[3] = { 17, 18, 19 };
+    const gl::vec3 v[2] = { gl::vec3(20, 21, 22), gl::vec3(23, 24, 25) };
+
+    p.put(1.0f);
+    p.put(gl::vec3(2, 3, 4));
+    p.put(gl::vec2(5, 6));
+    p.put(gl::mat3(7, 8, 9, 10, 11, 12, 13, 14, 15));
+    p.put(16.0f);
+    p.put(f, 3);
+    p.put(v, 2);
+    p.put(26.0f);
+}
+
+static int check(const char *layout, const gl::uniform_packer& p,
+                 const member *m, int n, size_t size)
+{
+    const float *d = (const float *) p.get_data();
+    int errors = 0;
+
+    for (int i = 0; i < n; i++)
+        if (m[i].offset + 4 > p.get_size() || d[m[i].offset / 4] != m[i].value)
+        {
+            fprintf(stderr, "%s: %s not at offset %d\n", layout, m[i].name,
+                                                    int(m[i].offset));
+            errors++;
+        }
+
+    if (p.get_size() != size)
+    {
+        fprintf(stderr, "%s: size %d, expected %d\n", layout,
+                                  int(p.get_size()), int(size));
+        errors++;
+    }
+    return errors;
+}
+
+int main()
+{
+    // Offsets as reported by the GL for the same block.
+
+    const member std140[] = {
+        { "a",      0,  1 }, { "b",     16,  2 }, { "c",     32,  5 },
+        { "m[0]",  48,  7 }, { "m[1]",  64,  8 }, { "m[2]",  80,  9 },
+        { "d",     96, 16 }, { "f[0]", 112, 17 }, { "f[1]", 128, 18 },
+        { "f[2]", 144, 19 }, { "v[0]", 160, 20 }, { "v[1]", 176, 23 },
+        { "e",    192, 26 },
+    };
+    const member std430[] = {
+        { "a",      0,  1 }, { "b",     16,  2 }, { "c",     32,  5 },
+        { "m[0]",  48,  7 }, { "m[1]",  64,  8 }, { "m[2]",  80,  9 },
+        { "d",     96, 16 }, { "f[0]", 100, 17 }, { "f[1]", 104, 18 },
+        { "f[2]", 108, 19 }, { "v[0]", 112, 20 }, { "v[1]", 128, 23 },
+        { "e",    144, 26 },
+    };
+
+    gl::uniform_packer p;
+    gl::uniform_packer q(true);
+
+    pack(p);
+    pack(q);
+
+    int errors = check("std140", p, std140, 13, 196)
+               + check("std430", q, std430, 13, 148);
+
+    if (errors == 0)
+        printf("uniform_packer: ok\n");
+
+    return errors ? 1 : 0;
+}